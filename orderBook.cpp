@@ -1,56 +1,51 @@
-#include <numeric> // Include the necessary header file for the 'std::accumulate' function.
 #include <iostream>
 #include <cstdint>
 #include <vector>
-#include <list>
 #include <memory>
-#include <format>
 #include <chrono>
-#include <time>
-
-void Orderbook::PruneGoodForDayOrders()
-{
-     using namespace std::chrono;
-     const auto end = hours(16);
-        while (true)
-        {
-                const auto now = system_clock::now();
-                const auto now_c = system_clock::to_time_t(now);
-                std::tm now_parts;
-                localtime_s(&now_parts, &now_c);
-
-                if (now_parts.tm_hour >= end.count())
-                    now_parts.tm_mday += 1;
-
-                now_parts.tm_hour = end.count();
-                now_parts.tm_min = 0;
-                now_parts.tm_sec = 0;
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <limits>
+#include <optional>
+#include <algorithm>
+#include <array>
+#include <functional> // Include the necessary header file for the 'std::greater' and 'std::less' comparators.
+#include <map>
+#include <unordered_map>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <atomic>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <random>
+#include <type_traits>
 
-                auto next = system_clock::from_time_t(mktime(&now_parts));
-                auto till = next - now + milliseconds(100);
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
-                {
-                    std::unique_lock ordersLock{ ordersMutex_ };
-                    if (shutdown_.load(std::memory_order_acquire) ||
-                            shutdownConditionVariable_.wait_for(ordersLock, till) == std::cv_status::no_timeout)
-                            return;
-                }
-                OrderIds orderIds;
-                {
-                    std::scoped_lock ordersLock{ ordersMutex_ };
-                    for (const auto& [_, entry] : orders_)
-                    {
-                        const auto& [order, _] = entry;
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
 
-                        if (order->GetOrderType() != OrderType::GoodForDay)\
-                                continue;
-                        orderIds.push_back(order->GetOrderId());
+using Price = std::int32_t;
+using Quantity = std::uint32_t;
+using OrderId = std::uint32_t;
+using OrderIds = std::vector<OrderId>;
+using OrderIndex = std::uint32_t; // slot of an order in the Orderbook's slab
+using ParticipantId = std::uint32_t;
+using Symbol = std::string;
 
-                    }
-                }
-            CancelOrders(orderIds);
-        }
-}
+struct Constants
+{
+    static constexpr Price InvalidPrice = std::numeric_limits<Price>::max();
+    static constexpr OrderIndex InvalidOrderIndex = std::numeric_limits<OrderIndex>::max();
+    static constexpr ParticipantId InvalidParticipant = std::numeric_limits<ParticipantId>::max();
+};
 
 enum class OrderType
 {
@@ -59,6 +54,8 @@ enum class OrderType
     FillOrKill,
     GoodForDay,
     Market,
+    Stop,      // activates as a market order when the tape crosses the stop price
+    StopLimit, // activates as a GoodTillCancel at its limit price
 };
 
 enum class Side
@@ -67,21 +64,6 @@ enum class Side
     Sell
 };
 
-#pragma once
-
-#include <limits>
-
-#include "Usings.h"
-
-struct Constants
-{
-    static const Price InvalidPrice = std::numeric_limits<Price>::quiet_NaN();
-};
-
-using Price = std::int32_t;
-using Quantity = std::uint32_t;
-using OrderId = std::uint32_t;
-
 struct LevelInfo {
     Price price_;
     Quantity quantity_;
@@ -89,13 +71,20 @@ struct LevelInfo {
 
 using LevelInfos = std::vector<LevelInfo>;
 
-class OrderbookLevelInfos 
+class OrderbookLevelInfos
 {
 public:
     OrderbookLevelInfos(const LevelInfos& bids, const LevelInfos& asks)
         : bids_{ bids }
         , asks_{ asks }
     { }
+    // Move overload for callers handing over freshly-built vectors; the
+    // copying overload stays for GetOrderInfos, whose reuse buffers must
+    // keep their capacity.
+    OrderbookLevelInfos(LevelInfos&& bids, LevelInfos&& asks)
+        : bids_{ std::move(bids) }
+        , asks_{ std::move(asks) }
+    { }
     const LevelInfos& GetBids() const { return bids_; }
     const LevelInfos& GetAsks() const { return asks_; }
 private:
@@ -103,21 +92,42 @@ private:
     LevelInfos asks_;
 };
 
-class Order 
+class Order
 {
 public:
-    Order(OrderType orderType, OrderId orderId, Side side, Price price, Quantity quantity)
-        : orderType_{ orderType }
+    Order(OrderType orderType, OrderId orderId, Side side, Price price, Quantity quantity,
+        ParticipantId ownerId = Constants::InvalidParticipant, Quantity displayQuantity = 0)
+        : remainingQuantity_{ quantity }
+        , visibleQuantity_{ displayQuantity == 0 ? quantity : std::min(displayQuantity, quantity) }
+        , price_{ price }
         , orderId_{ orderId }
         , side_{ side }
-        , price_{ price }
+        , orderType_{ orderType }
         , initialQuantity_{ quantity }
-        , remainingQuantity_{ quantity }
+        , displayQuantity_{ displayQuantity }
+        , ownerId_{ ownerId }
         { }
 
         Order(OrderId orderId, Side side, Quantity quantity)
             : Order(OrderType::Market, orderId, side, Constants::InvalidPrice, quantity)
         { }
+    // Snapshot restore: rebuilds an order mid-life, bypassing the normal
+    // fill arithmetic.
+    Order(OrderType orderType, OrderId orderId, Side side, Price price, Quantity initialQuantity,
+        Quantity remainingQuantity, Quantity visibleQuantity, Quantity displayQuantity,
+        Price stopPrice, ParticipantId ownerId)
+        : remainingQuantity_{ remainingQuantity }
+        , visibleQuantity_{ visibleQuantity }
+        , price_{ price }
+        , orderId_{ orderId }
+        , side_{ side }
+        , orderType_{ orderType }
+        , initialQuantity_{ initialQuantity }
+        , displayQuantity_{ displayQuantity }
+        , stopPrice_{ stopPrice }
+        , ownerId_{ ownerId }
+        { }
+
     OrderId GetOrderId() const { return orderId_; }
     Side GetSide() const { return side_; }
     Price GetPrice() const { return price_; }
@@ -125,24 +135,87 @@ public:
     Quantity GetInitialQuantity() const { return initialQuantity_; }
     Quantity GetRemainingQuantity() const { return remainingQuantity_; }
     Quantity GetFilledQuantity() const {return GetInitialQuantity() - GetRemainingQuantity(); }
+    ParticipantId GetOwnerId() const { return ownerId_; }
     bool isFilled() const { return GetRemainingQuantity() == 0;}
 
+    // Iceberg support: only the visible slice sits in the level aggregates
+    // and is eligible to match; the hidden remainder replenishes it in
+    // place. Regular orders are fully visible.
+    bool IsIceberg() const { return displayQuantity_ != 0; }
+    Price GetStopPrice() const { return stopPrice_; }
+    void SetStopPrice(Price stopPrice) { stopPrice_ = stopPrice; }
+    Quantity GetDisplayQuantity() const { return displayQuantity_; }
+    Quantity GetVisibleQuantity() const { return visibleQuantity_; }
+
+    // Restores the visible slice after a full display fill; returns the
+    // freshly displayed quantity.
+    Quantity Replenish()
+    {
+        visibleQuantity_ = std::min(displayQuantity_, remainingQuantity_);
+        return visibleQuantity_;
+    }
+
     void Fill (Quantity quantity) {
         if (quantity > GetRemainingQuantity())
-            throw std::logic_error(std::format("Order ({}) cannot be filled for more than its remaining quantity.", GetOrderId()));
+            throw std::logic_error("Order (" + std::to_string(GetOrderId()) + ") cannot be filled for more than its remaining quantity.");
         remainingQuantity_ -= quantity;
+        visibleQuantity_ -= std::min(visibleQuantity_, quantity);
+    }
+
+    void ToGoodTillCancel(Price price)
+    {
+        price_ = price;
+        orderType_ = OrderType::GoodTillCancel;
+    }
+
+    // In-place modify support: rewrite side, price and quantity as if the
+    // order were newly admitted, keeping the cold fields (type, owner,
+    // display setting) intact so a modify never loses them.
+    void Rewrite(Side side, Price price, Quantity quantity)
+    {
+        side_ = side;
+        price_ = price;
+        initialQuantity_ = quantity;
+        remainingQuantity_ = quantity;
+        visibleQuantity_ = displayQuantity_ == 0 ? quantity : std::min(displayQuantity_, quantity);
+    }
+
+    // In-place modify support: shrink the open quantity without losing
+    // queue position. Keeps the filled quantity consistent by treating the
+    // reduction as a smaller original order.
+    void ReduceQuantityTo(Quantity quantity)
+    {
+        initialQuantity_ -= GetRemainingQuantity() - quantity;
+        remainingQuantity_ = quantity;
+        visibleQuantity_ = std::min(visibleQuantity_, quantity);
     }
+
+    // Intrusive queue links: the order itself is a node in its price level's
+    // FIFO, threaded through the Orderbook's contiguous slab by slot index.
+    OrderIndex GetPrev() const { return prev_; }
+    OrderIndex GetNext() const { return next_; }
+    void SetPrev(OrderIndex prev) { prev_ = prev; }
+    void SetNext(OrderIndex next) { next_ = next; }
 private:
-    OrderType orderType_;
+    // Hot fields first: the fill arithmetic and the FIFO walk read only
+    // this leading block, so a fill usually touches a single cache line
+    // even when the slot straddles two.
+    Quantity remainingQuantity_;
+    Quantity visibleQuantity_;
+    OrderIndex next_{ Constants::InvalidOrderIndex };
+    Price price_;
     OrderId orderId_;
     Side side_;
-    Price price_;
+    OrderType orderType_;
+    // Cold fields: read on admission, cancel, or snapshot only.
     Quantity initialQuantity_;
-    Quantity remainingQuantity_;
+    Quantity displayQuantity_; // 0 = not an iceberg
+    Price stopPrice_{ Constants::InvalidPrice };
+    ParticipantId ownerId_{ Constants::InvalidParticipant };
+    OrderIndex prev_{ Constants::InvalidOrderIndex };
 };
 
 using OrderPointer = std::shared_ptr<Order>;
-using OrderPointers = std::list<OrderPointer>;
 
 class OrderModify
 {
@@ -161,12 +234,12 @@ public:
 
     OrderPointer ToOrderPoint(OrderType type) const
     {
-        return std::make_shared<Order>(type, GetOrderId(), GetPrice(), GetQuantity());
+        return std::make_shared<Order>(type, GetOrderId(), GetSide(), GetPrice(), GetQuantity());
     }
 private:
     OrderId orderId_;
-    Price price_;
     Side side_;
+    Price price_;
     Quantity quantity_;
 };
 
@@ -177,363 +250,2850 @@ struct TradeInfo
     Quantity quantity_;
 };
 
+// Per-book event stamps. One monotonic sequence covers both trades and
+// level updates, so the two streams merge into a single total order
+// without consumers reading a clock of their own. The timestamp source
+// is selectable: the raw cycle counter is cheapest but only comparable
+// within one core's TSC domain; SteadyClock gives steady_clock ticks,
+// comparable across books on the same host.
+using SequenceNumber = std::uint64_t;
+using EventTimestamp = std::uint64_t;
+
+enum class TimestampSource
+{
+    CycleCounter,
+    SteadyClock,
+};
+
 class Trade
 {
 public:
-    Trade(const TradeInfo& bidTrade, const TradeInfo& askTrade)
+    Trade() = default; // empty slot in a preallocated trade ring
+
+    Trade(const TradeInfo& bidTrade, const TradeInfo& askTrade,
+        SequenceNumber sequence = 0, EventTimestamp timestamp = 0)
         : bidTrade_{ bidTrade }
         , askTrade_{ askTrade }
+        , sequence_{ sequence }
+        , timestamp_{ timestamp }
     { }
 
     const TradeInfo& GetBidTrade() const { return bidTrade_; }
     const TradeInfo& GetAskTrade() const { return askTrade_; }
+    SequenceNumber GetSequence() const { return sequence_; }
+    EventTimestamp GetTimestamp() const { return timestamp_; }
 private:
-    TradeInfo bidTrade_;
-    TradeInfo askTrade_;
+    TradeInfo bidTrade_{ };
+    TradeInfo askTrade_{ };
+    SequenceNumber sequence_{ };
+    EventTimestamp timestamp_{ };
 };
 
-using Trades = std::vector<Trade>;
-
-#include <map> // Include the necessary header file for the 'std::map' container.
-#include <functional> // Include the necessary header file for the 'std::greater' and 'std::less' comparators.
-
-class OrderBook
+// Trade handoff container: an add produces zero to a handful of trades
+// almost always, so the first InlineCapacity land in an inline array and
+// the heap is touched only when a sweep runs deeper. Storage is
+// contiguous in both modes, so iteration is pointer-based either way;
+// the interface mirrors the std::vector subset the call sites use.
+class Trades
 {
-private:
-    struct OrderEntry
-    {
-        OrderPointer order_{ nullptr };
-        OrderPointers::iterator location_;
-    };
-    struct LevelData
-    {
-        Quantity quantity_{ };
-        Quantity count_{ };
-
-        enum class Action
-        {
-            Add,
-            Remove,
-            Match,
-        };
-    };
-    std::unordered_map<Price, LevelData> data_;
-    std::map<Price, OrderPointers, std::greater<Price>> bids_;
-    std::map<Price, OrderPointers, std::less<Price>> asks_;
-    std::unordered_map<OrderId, OrderEntry> orders_;
-    mutable std::mutex ordersMutex_;
-    std::thread ordersPruneThread_;
-    std::condition_variable shutdownConditionVariable_;
-    std::atomic<bool> shutdown_{ false };
-
-    void PruneGoodForDayOrders();
-
-    void CancelOrders(OrderIds orderIds);
-    void CancelOrderInternal(OrderId orderId);
-
-    void OnOrderCancelled(OrderPointer order);
-    void OnOrderAdded(OrderPointer order);
-    void OnOrderMatched(Price price, Quantity quantity, bool isFullyFilled);
-    void UpdateLevelData(Price price, Quantity quantity, LevelData::Action action);
+public:
+    static constexpr std::size_t InlineCapacity = 4;
 
-    bool CanFullyFill(Side side, Price price, Quantity quantity) const;
-    bool CanMatch(Side side, Price price) const
+    void push_back(const Trade& trade)
     {
-        if (side == Side::Buy)
+        if (size_ < InlineCapacity)
         {
-            if (asks_.empty())
-                return false; // cant match
-            const auto& [bestAsk, _] = *asks_.begin();
-            return price >= bestAsk;
+            inline_[size_++] = trade;
+            return;
         }
-        else
+        if (size_ == InlineCapacity && spill_.empty())
         {
-            if (bids_.empty())
-                return false; // cant match
-            const auto& [bestBid, _] = *bids_.begin();
-            return price <= bestBid;
+            // First spill: migrate the inline trades so storage stays
+            // contiguous.
+            spill_.reserve(InlineCapacity * 2);
+            spill_.assign(inline_.begin(), inline_.end());
         }
+        spill_.push_back(trade);
+        ++size_;
     }
 
-    Trades MatchOrders()
+    bool empty() const { return size_ == 0; }
+    std::size_t size() const { return size_; }
+    const Trade* data() const { return size_ <= InlineCapacity ? inline_.data() : spill_.data(); }
+    const Trade* begin() const { return data(); }
+    const Trade* end() const { return data() + size_; }
+    const Trade& operator[](std::size_t index) const { return begin()[index]; }
+    const Trade& front() const { return *begin(); }
+    const Trade& back() const { return *(end() - 1); }
+    void clear()
     {
-        Trades trades;
-        trades.reserve(orders_.size());
+        size_ = 0;
+        spill_.clear();
+    }
 
-        while(true)
-        {
-            if (bids_.empty() || asks_.empty())
-                break;
-            
-            auto& [bidPrice, bids] = *bids_.begin();
-            auto& [askPrice, asks] = *asks_.begin();
+private:
+    std::size_t size_{ 0 };
+    std::array<Trade, InlineCapacity> inline_{ };
+    std::vector<Trade> spill_;
+};
 
-            if (bidPrice < askPrice)
-                break;
-            
-            while (bids.size() && asks.size())
-            {
-                auto& bid = bids.front();
-                auto& ask = asks.front();
+// Top-of-book snapshot returned by value; price is InvalidPrice when the
+// side is empty.
+struct BBO
+{
+    LevelInfo bid_{ Constants::InvalidPrice, 0 };
+    LevelInfo ask_{ Constants::InvalidPrice, 0 };
 
-                Quantity quantity = std::min(bid->GetRemainingQuantity(), ask->GetRemainingQuantity());
-                bid->Fill(quantity);
-                ask->Fill(quantity);
+    bool HasBid() const { return bid_.price_ != Constants::InvalidPrice; }
+    bool HasAsk() const { return ask_.price_ != Constants::InvalidPrice; }
+};
 
-                if (bid->isFilled())
-                {
-                    bids.pop_front();
-                    orders_.erase(bid->GetOrderId());
-                }
+// What a level-quantity change was caused by; also the event type of the
+// market-data delta stream.
+// Compile-time instrumentation switch: build with
+// -DORDERBOOK_INSTRUMENTATION=1 to collect hot-path cycle counters and
+// match-depth stats; at the default 0 every probe is an empty inline and
+// compiles away entirely.
+#ifndef ORDERBOOK_INSTRUMENTATION
+#define ORDERBOOK_INSTRUMENTATION 0
+#endif
 
-                if (bids.empty())
-                    bids_.erase(bidPrice);
-                if (asks.empty())
-                    asks_.erase(askPrice);
-                
-                trades.push_back(Trade{
-                    TradeInfo{ bid->GetOrderId(), bid->GetPrice(), quantity},
-                    TradeInfo{ ask->GetOrderId(), ask->GetPrice(), quantity}
-                });
-            }
-        }
-        if (!bids_.empty())
-        {
-            auto& [_, bids] = *bids_.begin();
-            auto& order = bids.front();
-            if (order->GetOrderType() == OrderType::FillAndKill)
-                CancelOrder(order->GetOrderId());
-        }
-        if (!asks_.empty())
-        {
-            auto& [_, asks] = *asks_.begin();
-            auto& order = asks.front();
-            if (order->GetOrderType() == OrderType::FillAndKill)
-                CancelOrder(order->GetOrderId());
-        }
-        return trades;
-    }
-    Orderbook::Orderbook(): orderPruneThread_{ [this] {PruneGoodForDayOrders();}} { }\
-    Orderbook::~Orderbook()
+inline constexpr bool InstrumentationEnabled = ORDERBOOK_INSTRUMENTATION != 0;
+
+inline std::uint64_t ReadCycleCounter()
 {
-    shutdown_.store(true, std::memory_order_release);
-	shutdownConditionVariable_.notify_one();
-	ordersPruneThread_.join();
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return static_cast<std::uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+#endif
 }
+
+// Snapshot of the hot-path counters, scrapeable without locking. Cycle
+// sums divide by the matching call counters for per-op averages (e.g.
+// tradesEmitted_ / matchCalls_ = trades per match cycle).
+struct HotPathStats
+{
+    std::uint64_t addCalls_{ };
+    std::uint64_t addCycles_{ };
+    std::uint64_t cancelCalls_{ };
+    std::uint64_t cancelCycles_{ };
+    std::uint64_t matchCalls_{ };
+    std::uint64_t matchCycles_{ };
+    std::uint64_t lockAcquisitions_{ };
+    std::uint64_t lockHoldCycles_{ };
+    std::uint64_t tradesEmitted_{ };
+    std::uint64_t levelsSwept_{ };
+    std::uint64_t fakReprices_{ };
+    std::uint64_t orderTableResizes_{ };
+};
+
+enum class LevelAction
+{
+    Add,
+    Remove,
+    Match,
+    Replenish, // an iceberg redisplayed a slice: quantity only, no new order
+};
+
+// What to do when the would-be counterparties in MatchOrders share an
+// owner. None disables the check entirely.
+enum class SelfTradePolicy
+{
+    None,
+    CancelNewest,
+    CancelOldest,
+    DecrementAndCancel,
+};
+
+// One incremental book update: the book already knows exactly what changed
+// on every add, cancel and fill, so subscribers get (side, action, price,
+// new aggregate quantity) and can maintain their own copy with O(1) work
+// per event instead of diffing full snapshots.
+struct LevelUpdate
+{
+    Side side_;
+    LevelAction action_;
+    Price price_;
+    Quantity quantity_; // aggregate resting quantity at the level after the update
+    SequenceNumber sequence_{ };
+    EventTimestamp timestamp_{ };
+};
+
+// Aggregates published through the same seqlock as the BBO so monitoring
+// and strategy threads can snapshot them at any rate without contending
+// with matching. Depth covers the top PublishedDepth levels per side; full
+// depth still goes through GetOrderInfos.
+struct BookStats
+{
+    static constexpr std::size_t PublishedDepth = 8;
+
+    std::size_t orderCount_{ };
+    std::size_t bidLevelCount_{ };
+    std::size_t askLevelCount_{ };
+    std::array<LevelInfo, PublishedDepth> bidDepth_{ };
+    std::array<LevelInfo, PublishedDepth> askDepth_{ };
+};
+
+// Per-participant running exposure, maintained incrementally by the same
+// hooks that keep the level aggregates, so admission checks are O(1)
+// lookups instead of a shadow copy of the book.
+struct ParticipantExposure
+{
+    std::size_t orderCount_{ };
+    std::uint64_t openQuantity_{ };
+    std::uint64_t openNotional_{ }; // sum of price * remaining over open orders
+};
+
+// Admission limits for one participant; every field defaults to
+// unlimited, so a partially-filled limits object constrains only what it
+// names.
+struct ParticipantLimits
+{
+    std::size_t maxOrderCount_{ std::numeric_limits<std::size_t>::max() };
+    std::uint64_t maxOpenQuantity_{ std::numeric_limits<std::uint64_t>::max() };
+    std::uint64_t maxOpenNotional_{ std::numeric_limits<std::uint64_t>::max() };
+};
+
+// One price level: a FIFO of resting orders held as an intrusive
+// doubly-linked list threaded through the order slab, so the level itself
+// carries no per-order allocations.
+struct Level
+{
+    Price price_;
+    OrderIndex head_{ Constants::InvalidOrderIndex };
+    OrderIndex tail_{ Constants::InvalidOrderIndex };
+
+    bool HasOrders() const { return head_ != Constants::InvalidOrderIndex; }
+};
+
+// Contiguous price ladder replacing the std::map sides. Levels live in one
+// sorted vector with the best price at the back, so best-level access and
+// removal are O(1) and opening a level near the touch only shifts a handful
+// of entries instead of allocating a tree node. Compare is the same
+// comparator the maps used (std::greater for bids, std::less for asks).
+template <typename Compare>
+class PriceLevels
+{
 public:
-    Trades Orderbook::AddOrder(OrderPointer order)
-    {
-        std::scoped_lock ordersLock{ ordersMutex_};
-        
-        if (orders_.contains(order->GetOrderId()))
-            return {};
-        if (order->GetOrderType() == OrderType::FillAndKill && !CanMatch(order->GetSide(), order->GetPrice()))
-            {
-                if (order->GetSide() == Side::Buy && !asks_.empty())
-                {
-                    const auto& [worstAsk, _] = *asks_.rbegin();
-                    order->ToGoodTillCancel(worstAsk);
-                }
-                else if (order->GetSide() == Side::Sell && !bids_.empty())
-                {
-                    const auto& [worstBid, _] = *bids_.rbegin();
-                    order->ToGoodTillCancel(worstBid);
-                }
-		else
-            return {};
-            }
-            if (order->GetOrderType() == OrderType::FillAndKill && !CanMatch(order->GetSide(), order->GetPrice()))
-                return { };
-            if (order->GetOrderType() == OrderType::FillOrKill && !CanFullyFill(order->GetSide(), order->GetPrice(), order->GetInitialQuantity()))
-                return { };
-        OrderPointers::iterator iterator;
+    bool Empty() const { return levels_.empty(); }
+    std::size_t Size() const { return levels_.size(); }
 
-        if (order->GetSide() == Side::Buy)
-        {
-            auto& orders = bids_[order->GetPrice()];
-            orders.push_back(order);
-            iterator = std::next(orders.begin(), orders.size() - 1);
-        }
-        else
-        {
-            auto& orders = asks_[order->GetPrice()];
-            orders.push_back(order);
-            iterator = std::next(orders.begin(), orders.size() - 1);
-        }
-        orders_.insert({order->GetOrderId(), OrderEntry{ order, iterator} });
-        OnOrderAdded(order);
-        return MatchOrders(); // run matching algorithm
-    }
-    
-    void Orderbook::CancelOrderInternal(OrderId orderId)
-    {
-        std::scoped_lock ordersLock{ ordersMutex_ };
+    Level& Best() { return levels_.back(); }
+    const Level& Best() const { return levels_.back(); }
+    Price BestPrice() const { return levels_.back().price_; }
 
-        for (const auto& orderId : orderIds)
-                CancelOrderInternal(orderId);
-    }
-    
-    void Orderbook::CancelOrderInternal(OrderId orderId)
+    // Worst price on the side, i.e. what the maps exposed through rbegin().
+    Price WorstPrice() const { return levels_.front().price_; }
+
+    Level& GetOrCreate(Price price)
     {
-        if (!orders_.contains(orderId))
-            return;
-        const auto [order, iterator] = orders_.at(orderId);
-        orders_.erase(orderId);
-        if (order->GetSide() == Side::Sell)
-        {
-            auto price = order->GetPrice();
-            auto& orders = asks_.at(price);
-            orders.erase(iterator);
-            if (orders.empty())
-                asks_.erase(price);
-        }
-        else
-        {
-            auto price = order->GetPrice();
-            auto& orders = bids_.at(price);
-            orders.erase(iterator);
-            if (orders.empty())
-                bids_.erase(price);
-        }
-        OnOrderCancelled(order);
+        auto it = LowerBound(price);
+        if (it != levels_.end() && it->price_ == price)
+            return *it;
+        return *levels_.insert(it, Level{ price });
     }
-    void Orderbook::OnOrderCancelled(OrderPointer order)
+
+    Level* Find(Price price)
     {
-        UpdateLevelData(order->GetPrice(), order->GetRemainingQuantity(), LevelData::Action::Remove);
+        auto it = LowerBound(price);
+        if (it != levels_.end() && it->price_ == price)
+            return &*it;
+        return nullptr;
     }
-    void Orderbook::OnOrderAdded(OrderPointer order)
+
+    void Erase(Price price)
     {
-        UpdateLevelData(order->GetPrice(), order->GetInitialQuantity(), LevelData::Action::Add);
+        auto it = LowerBound(price);
+        if (it != levels_.end() && it->price_ == price)
+            levels_.erase(it);
     }
-    void Orderbook::OnOrderMatched(Price price, Quantity quantity, bool isFullyFilled)
+
+    void EraseBest() { levels_.pop_back(); }
+
+    // Levels in best-to-worst order, matching map iteration order.
+    auto begin() const { return levels_.rbegin(); }
+    auto end() const { return levels_.rend(); }
+
+private:
+    // Sorted with the best price (first in Compare order) at the back.
+    typename std::vector<Level>::iterator LowerBound(Price price)
     {
-        UpdateLevelData(price, quantity, isFullyFilled ? LevelData::Action::Remove : LevelData::Action::Match);
+        return std::lower_bound(levels_.begin(), levels_.end(), price,
+            [this](const Level& level, Price value) { return comp_(value, level.price_); });
     }
-    void Orderbook::UpdateLevelData(Price price, Quantity quantity, LevelData::Action action)
+
+    std::vector<Level> levels_;
+    Compare comp_;
+};
+
+// Next 16:00 local-time cutoff after now; shared by the per-book prune
+// thread and the engine's timer service.
+static std::chrono::system_clock::time_point NextGoodForDayExpiry()
+{
+    using namespace std::chrono;
+    const auto end = hours(16);
+    const auto now = system_clock::now();
+    const auto now_c = system_clock::to_time_t(now);
+    std::tm now_parts;
+    localtime_r(&now_c, &now_parts);
+
+    if (now_parts.tm_hour >= end.count())
+        now_parts.tm_mday += 1;
+
+    now_parts.tm_hour = end.count();
+    now_parts.tm_min = 0;
+    now_parts.tm_sec = 0;
+
+    return system_clock::from_time_t(mktime(&now_parts));
+}
+
+// Order-id -> slab-slot lookup. The gateway assigns dense sequential ids,
+// so the common case is a single vector index — no hashing and one cache
+// line, versus two misses (bucket plus node) in the chained map this
+// replaces. Ids beyond the dense window spill into an overflow map so
+// sparse id spaces still work.
+class OrderTable
+{
+public:
+    // 4M direct slots (16 MiB of indices) before ids spill to overflow.
+    static constexpr std::size_t DenseLimit = std::size_t{ 1 } << 22;
+
+    bool Contains(OrderId orderId) const
     {
-            auto& data = data_[price];
-            data.count_ += action == LevelData::Action::Remove ? -1 : action == LevelData::Action::Add ? 1 : 0;
-            if (action == LevelData::Action::Remove || action == LevelData::Action::Match)
-            {
-                data.quantity_ -= quantity;
-            }
-            else
-            {
-                data.quantity_ += quantity;
-            }
-            if (data.count_ == 0)
-                data_.erase(price);
+        return Find(orderId) != Constants::InvalidOrderIndex;
     }
-    bool Orderbook::CanFullyFill(Side side, Price price, Quantity quantity) const
-    {
-        if (!CanMatch(side, price))
-            return false;
-        
-        std::optional<Price> threshold;
-
-        if (side == Side::Buy)
-        {
-            const auto [askPrice, _] = *asks_.begin();
-            threshold = askPrice;
-        }
-        else
-        {
-            const auto [bidPrice, _] = *bids_.begin();
-            threshold = bidPrice;
-        }
 
-        for (const auto& [levelPrice, levelData] : data_)
-        {
-            if (threshold.has_value() &&
-                (side == Side::Buy && threshold.value() > levelPrice) ||
-                (side == Side::Sell && threshold.value() < levelPrice))
-                continue;
-            if ((side == Side::Buy && levelPrice > price) ||
-                (side == Side::Sell && levelPrice < price))
-                continue;
-            if (quantity <= levelData.quantity_)
-                return true;
-            quantity -= levelData.quantity_;
-        }
-        return false;
+    OrderIndex Find(OrderId orderId) const
+    {
+        if (orderId < dense_.size())
+            return dense_[orderId];
+        if (orderId < DenseLimit)
+            return Constants::InvalidOrderIndex;
+        const auto it = overflow_.find(orderId);
+        return it == overflow_.end() ? Constants::InvalidOrderIndex : it->second;
     }
-    bool Orderbook::CanMatch(Side side, Price price) const
+
+    void Insert(OrderId orderId, OrderIndex index)
     {
-        if (side == Side::Buy)
+        if (orderId < DenseLimit)
         {
-            if (asks_.empty())
-                return false;
-
-            const auto& [bestAsk, _] = *asks_.begin();
-            return price >= bestAsk;
+            if (orderId >= dense_.size())
+            {
+                // Clamp the doubling at DenseLimit: Find/Erase route on
+                // dense_.size(), so growing past the limit would leave ids
+                // in [DenseLimit, size) inserted into overflow_ but looked
+                // up in dense_.
+                dense_.resize(std::min<std::size_t>(DenseLimit,
+                    std::max<std::size_t>(orderId + 1, dense_.size() * 2)), Constants::InvalidOrderIndex);
+                ++resizes_;
+            }
+            dense_[orderId] = index;
         }
         else
-        {
-            if (bids_.empty())
-                return false;
-            
-            const auto& [bestBid, _] = *bids_.begin();
-            return price <= bestBid;
-        }
-    }
-    
-    
-    
-    void Orderbook::CancelOrder(OrderId orderId)
-    {
-        std::scoped_lock ordersLock{ ordersMutex_ };
-        CancelOrderInternal(orderId);
+            overflow_[orderId] = index;
+        ++size_;
     }
-    Trades Orderbook::ModifyOrder(OrderModify order)
+
+    void Erase(OrderId orderId)
     {
-        OrderType orderType;
+        if (orderId < dense_.size())
         {
-            std::scoped_lock ordersLock{ ordersMutex_ };
-
-            if (!orders_.contains(order.GetOrderId()))
-                return { };
-            const auto& [existingOrder, _] = orders_.at(order.GetOrderId());
-            orderType = existingOrder->GetOrderType();
+            if (dense_[orderId] == Constants::InvalidOrderIndex)
+                return;
+            dense_[orderId] = Constants::InvalidOrderIndex;
+            --size_;
         }
-        CancelOrder(order.GetOrderId());
-        return AddOrder(order.ToOrderPoint(existingOrder->GetOrderType()));
+        else if (orderId >= DenseLimit)
+            size_ -= overflow_.erase(orderId);
     }
 
-    std::size_t Orderbook::Size() const
+    std::size_t Size() const { return size_; }
+    std::uint64_t ResizeCount() const { return resizes_; }
+
+private:
+    std::vector<OrderIndex> dense_;
+    std::unordered_map<OrderId, OrderIndex> overflow_;
+    std::size_t size_ = 0;
+    std::uint64_t resizes_ = 0; // advisory diagnostic, see GetHotPathStats
+};
+
+// Fixed-capacity lock-free single-producer/single-consumer ring buffer.
+// One gateway thread pushes, one matching thread pops; the indices only ever
+// move forward, so a release store on the producer side paired with an
+// acquire load on the consumer side is all the synchronization needed.
+template <typename T>
+class SPSCQueue
+{
+public:
+    explicit SPSCQueue(std::size_t capacity)
+        : buffer_(RoundUpPowerOfTwo(capacity))
+        , mask_{ buffer_.size() - 1 }
+    { }
+
+    bool TryPush(const T& value)
     {
-        std::scoped_lock ordersLock{ ordersMutex_ };
-        return orders_.size(); 
+        const auto tail = tail_.load(std::memory_order_relaxed);
+        if (tail - head_.load(std::memory_order_acquire) == buffer_.size())
+            return false; // full
+        buffer_[tail & mask_] = value;
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
     }
 
-    OrderbookLevelInfos Orderbook::GetOrderInfos() const
+    bool TryPop(T& value)
     {
-        LevelInfos bidInfos, askInfos;
-        bidInfos.reserve(orders_.size());
-        bidInfos.reserve(asks_.size());
+        const auto head = head_.load(std::memory_order_relaxed);
+        if (head == tail_.load(std::memory_order_acquire))
+            return false; // empty
+        value = buffer_[head & mask_];
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
 
-        auto CreateLevelInfos = [](Price price, const OrderPointers& orders)
-        {
-            return LevelInfo(price, std::accumulate(orders.begin(), orders.end(), (Quantity)0,
-            [](std::size_t runningSum, const OrderPointer& order)
-            {
-                return runningSum + order->GetRemainingQuantity();
-            }));
-        };
-        for (const auto& [price, orders] : bids_)
-            bidInfos.push_back(CreateLevelInfos(price, orders));
-        for (const auto& [price, orders] : asks_)
-            askInfos.push_back(CreateLevelInfos(price, orders));
-        
-        return OrderbookLevelInfos(bidInfos, askInfos);
+private:
+    static std::size_t RoundUpPowerOfTwo(std::size_t value)
+    {
+        std::size_t power = 1;
+        while (power < value)
+            power <<= 1;
+        return power;
     }
+
+    std::vector<T> buffer_;
+    std::size_t mask_;
+    alignas(64) std::atomic<std::size_t> head_{ 0 };
+    alignas(64) std::atomic<std::size_t> tail_{ 0 };
 };
 
-int main() {
-    OrderBook orderbook;
-    const OrderId orderId = 1;
-    orderbook.AddOrder(std::make_shared<Order>(OrderType::GoodTillCancel, orderId, Side::Buy, 100, 10));
+// One submitted gateway command, sized so the ring buffer holds plain
+// fixed-size records.
+struct OrderCommand
+{
+    enum class Type
+    {
+        Add,
+        Cancel,
+        Modify,
+    };
+
+    Type type_;
+    OrderType orderType_;
+    OrderId orderId_;
+    Side side_;
+    Price price_;
+    Quantity quantity_;
+    ParticipantId ownerId_{ Constants::InvalidParticipant };
+    Quantity displayQuantity_{ 0 }; // nonzero marks an iceberg add
+    Price stopPrice_{ Constants::InvalidPrice }; // set for Stop/StopLimit adds
+    std::int64_t expiryNanos_{ 0 }; // nonzero marks an add with its own expiry
+};
+
+// Append-only binary journal of order commands: a small versioned header
+// followed by fixed-size OrderCommand records. Appends go through stdio's
+// buffer and are flushed in batches, so the matching thread never waits on
+// a per-record write.
+class OrderJournal
+{
+public:
+    static constexpr std::uint32_t Magic = 0x4C4A424F; // "OBJL"
+    static constexpr std::uint32_t Version = 5; // v2 added ownerId_, v3 displayQuantity_, v4 stopPrice_, v5 expiryNanos_
+
+    struct Header
+    {
+        std::uint32_t magic_;
+        std::uint32_t version_;
+    };
+
+    explicit OrderJournal(const std::string& path, std::size_t flushEvery = 1024)
+        : file_{ std::fopen(path.c_str(), "wb") }
+        , flushEvery_{ flushEvery }
+    {
+        if (!file_)
+            throw std::runtime_error("Cannot open journal file: " + path);
+        const Header header{ Magic, Version };
+        std::fwrite(&header, sizeof(header), 1, file_);
+    }
+
+    ~OrderJournal()
+    {
+        if (file_)
+        {
+            std::fflush(file_);
+            std::fclose(file_);
+        }
+    }
+
+    OrderJournal(const OrderJournal&) = delete;
+    OrderJournal& operator=(const OrderJournal&) = delete;
+
+    void Append(const OrderCommand& command)
+    {
+        std::fwrite(&command, sizeof(command), 1, file_);
+        if (++pendingFlush_ >= flushEvery_)
+        {
+            std::fflush(file_);
+            pendingFlush_ = 0;
+        }
+    }
+
+private:
+    std::FILE* file_;
+    std::size_t flushEvery_;
+    std::size_t pendingFlush_{ 0 };
+};
+
+// Snapshot format: a versioned header, the tape state, then each book side
+// and stop ladder as level-grouped order records, then the expiry index.
+// Loading bulk-constructs the ladders instead of replaying flow.
+struct BookSnapshot
+{
+    static constexpr std::uint32_t Magic = 0x534E424F; // "OBNS"
+    static constexpr std::uint32_t Version = 1;
+
+    struct Header
+    {
+        std::uint32_t magic_;
+        std::uint32_t version_;
+    };
+
+    struct TapeRecord
+    {
+        Price lastTradePrice_;
+        std::uint64_t tradedNotional_;
+        std::uint64_t tradedVolume_;
+    };
+
+    struct OrderRecord
+    {
+        OrderType orderType_;
+        OrderId orderId_;
+        Side side_;
+        Price price_;
+        Quantity initialQuantity_;
+        Quantity remainingQuantity_;
+        Quantity visibleQuantity_;
+        Quantity displayQuantity_;
+        Price stopPrice_;
+        ParticipantId ownerId_;
+    };
+
+    struct LevelRecord
+    {
+        Price price_;
+        std::uint32_t orderCount_;
+    };
+
+    struct ExpiryRecord
+    {
+        std::int64_t expiryNanos_;
+        OrderId orderId_;
+    };
+};
+
+class Orderbook
+{
+public:
+    using TradeHandler = std::function<void(const Trades&)>;
+
+private:
+    struct LevelData
+    {
+        Quantity quantity_{ };
+        Quantity count_{ };
+
+        using Action = LevelAction;
+    };
+    std::unordered_map<Price, LevelData> data_;
+    // Recycled data_ nodes from recently-emptied levels; see
+    // EmplaceLevelData. Deep enough to absorb BBO churn, small enough
+    // that an idle book holds no meaningful dead memory.
+    static constexpr std::size_t LevelDataPoolDepth = 64;
+    std::vector<std::unordered_map<Price, LevelData>::node_type> levelDataPool_;
+    PriceLevels<std::greater<Price>> bids_;
+    PriceLevels<std::less<Price>> asks_;
+    // Trigger ladders for untriggered stop orders, keyed by stop price and
+    // threaded through the same slab. Buy stops fire as the tape rises, so
+    // the lowest stop is "best"; sell stops mirror that downward.
+    PriceLevels<std::less<Price>> buyStops_;
+    PriceLevels<std::greater<Price>> sellStops_;
+    Price lastTradePrice_{ Constants::InvalidPrice }; // tape reference for stop triggers
+    std::vector<Order> slab_; // contiguous storage for all resting orders
+    OrderIndex freeList_{ Constants::InvalidOrderIndex }; // recycled slab slots, chained through next_
+    OrderTable orders_;
+    SelfTradePolicy selfTradePolicy_{ SelfTradePolicy::None };
+    // Risk stage: running exposure per owner and the limits to enforce.
+    // With no limits registered the admission check is a single empty()
+    // branch; anonymous orders never touch either map.
+    std::unordered_map<ParticipantId, ParticipantExposure> exposures_;
+    std::unordered_map<ParticipantId, ParticipantLimits> participantLimits_;
+    // Market sweep bounds; both default to unbounded.
+    std::uint32_t maxMarketSweepLevels_{ std::numeric_limits<std::uint32_t>::max() };
+    Price maxMarketSlippage_{ Constants::InvalidPrice };
+    // Expiry index, earliest first: Good-For-Day orders are entered at the
+    // 16:00 cutoff and any order may carry its own expiry timestamp. Entries
+    // for orders that were filled or cancelled first are dropped lazily when
+    // their slot comes due, so the hot fill path never touches this map.
+    std::multimap<std::chrono::system_clock::time_point, OrderId> expiries_;
+    mutable std::mutex ordersMutex_;
+    std::condition_variable shutdownConditionVariable_;
+    std::atomic<bool> shutdown_{ false };
+    // Seqlock-published top of book and aggregate stats: the matching
+    // thread republishes after every book mutation (always under
+    // ordersMutex_, so single-writer) and readers spin on the version
+    // counter instead of taking the lock.
+    std::atomic<std::uint64_t> bboVersion_{ 0 };
+    BBO bbo_;
+    BookStats stats_;
+    // Reusable snapshot buffers for GetOrderInfos; mutable because a
+    // snapshot is logically const.
+    mutable LevelInfos bidInfosBuffer_;
+    mutable LevelInfos askInfosBuffer_;
+    // Market-data delta subscription: updates are pushed from UpdateLevelData
+    // into the subscriber's lock-free queue; a full queue drops the event and
+    // counts it rather than stalling matching.
+    SPSCQueue<LevelUpdate>* marketDataQueue_{ nullptr };
+    std::atomic<std::uint64_t> droppedMarketDataUpdates_{ 0 };
+    // Event stamping for trades and level updates. Single writer under
+    // ordersMutex_; the sequence is a relaxed atomic so GetEventSequence
+    // reads it lock-free.
+    std::atomic<SequenceNumber> eventSequence_{ 0 };
+    TimestampSource timestampSource_{ TimestampSource::SteadyClock };
+    // Incrementally maintained analytics inputs: trade-tape sums for VWAP
+    // and per-side open quantity for imbalance. Single writer under
+    // ordersMutex_; relaxed atomics let the accessors read lock-free.
+    std::atomic<std::uint64_t> tradedNotional_{ 0 };
+    std::atomic<std::uint64_t> tradedVolume_{ 0 };
+    std::atomic<std::uint64_t> bidOpenQuantity_{ 0 };
+    std::atomic<std::uint64_t> askOpenQuantity_{ 0 };
+    // Hot-path instrumentation counters (see HotPathStats); written relaxed
+    // under ordersMutex_, scraped without locking. Dead weight of a few
+    // cache lines when instrumentation is compiled out.
+    std::atomic<std::uint64_t> statAddCalls_{ 0 };
+    std::atomic<std::uint64_t> statAddCycles_{ 0 };
+    std::atomic<std::uint64_t> statCancelCalls_{ 0 };
+    std::atomic<std::uint64_t> statCancelCycles_{ 0 };
+    std::atomic<std::uint64_t> statMatchCalls_{ 0 };
+    std::atomic<std::uint64_t> statMatchCycles_{ 0 };
+    std::atomic<std::uint64_t> statLockAcquisitions_{ 0 };
+    std::atomic<std::uint64_t> statLockHoldCycles_{ 0 };
+    std::atomic<std::uint64_t> statTradesEmitted_{ 0 };
+    std::atomic<std::uint64_t> statLevelsSwept_{ 0 };
+    std::atomic<std::uint64_t> statFakReprices_{ 0 };
+    std::unique_ptr<OrderJournal> journal_;
+    std::unique_ptr<SPSCQueue<OrderCommand>> commandQueue_;
+    TradeHandler tradeHandler_;
+    std::atomic<bool> asyncRunning_{ false };
+    std::thread matchingThread_;
+    // Declared last so every member the prune thread touches is constructed
+    // before the thread starts.
+    std::thread ordersPruneThread_;
+
+    Order& OrderAt(OrderIndex index) { return slab_[index]; }
+    const Order& OrderAt(OrderIndex index) const { return slab_[index]; }
+
+    // Pool factory: hands out a slab slot, reusing one recycled by a cancel
+    // or a full fill before growing the slab, so steady-state churn never
+    // touches the global allocator.
+    OrderIndex AllocateOrder(const Order& order)
+    {
+        if (freeList_ != Constants::InvalidOrderIndex)
+        {
+            const OrderIndex index = freeList_;
+            freeList_ = OrderAt(index).GetNext();
+            OrderAt(index) = order;
+            return index;
+        }
+        slab_.push_back(order);
+        return static_cast<OrderIndex>(slab_.size() - 1);
+    }
+
+    void FreeOrder(OrderIndex index)
+    {
+        OrderAt(index).SetNext(freeList_);
+        freeList_ = index;
+    }
+
+    void EnqueueOrder(Level& level, OrderIndex index)
+    {
+        auto& order = OrderAt(index);
+        order.SetPrev(level.tail_);
+        order.SetNext(Constants::InvalidOrderIndex);
+        if (level.HasOrders())
+            OrderAt(level.tail_).SetNext(index);
+        else
+            level.head_ = index;
+        level.tail_ = index;
+    }
+
+    void DequeueOrder(Level& level, OrderIndex index)
+    {
+        auto& order = OrderAt(index);
+        if (order.GetPrev() != Constants::InvalidOrderIndex)
+            OrderAt(order.GetPrev()).SetNext(order.GetNext());
+        else
+            level.head_ = order.GetNext();
+        if (order.GetNext() != Constants::InvalidOrderIndex)
+            OrderAt(order.GetNext()).SetPrev(order.GetPrev());
+        else
+            level.tail_ = order.GetPrev();
+        order.SetPrev(Constants::InvalidOrderIndex);
+        order.SetNext(Constants::InvalidOrderIndex);
+    }
+
+    void PruneGoodForDayOrders()
+    {
+        using namespace std::chrono;
+        while (true)
+        {
+            system_clock::time_point next;
+            {
+                std::scoped_lock ordersLock{ ordersMutex_ };
+                next = expiries_.empty() ? NextGoodForDayExpiry() : expiries_.begin()->first;
+            }
+            auto till = next - system_clock::now() + milliseconds(100);
+
+            {
+                std::unique_lock ordersLock{ ordersMutex_ };
+                // A timeout (or a notify for a new earlier expiry) loops back
+                // to re-arm against the current earliest entry.
+                if (shutdownConditionVariable_.wait_for(ordersLock, till,
+                        [this] { return shutdown_.load(std::memory_order_acquire); }))
+                    return;
+            }
+            CancelExpiredOrders(system_clock::now());
+        }
+    }
+
+    void CancelOrderInternal(OrderId orderId)
+    {
+        const OrderIndex index = orders_.Find(orderId);
+        if (index == Constants::InvalidOrderIndex)
+            return;
+        auto& order = OrderAt(index);
+        orders_.Erase(orderId);
+        if (order.GetOrderType() == OrderType::Stop || order.GetOrderType() == OrderType::StopLimit)
+        {
+            // Untriggered stops sit in the trigger ladders and never touched
+            // the level aggregates, so no OnOrderCancelled here.
+            auto removeStop = [&](auto& stops)
+            {
+                const auto stopPrice = order.GetStopPrice();
+                auto* level = stops.Find(stopPrice);
+                DequeueOrder(*level, index);
+                if (!level->HasOrders())
+                    stops.Erase(stopPrice);
+            };
+            if (order.GetSide() == Side::Buy)
+                removeStop(buyStops_);
+            else
+                removeStop(sellStops_);
+            FreeOrder(index);
+            PublishBBO(); // keeps the published order count in step
+            return;
+        }
+        if (order.GetSide() == Side::Sell)
+        {
+            auto price = order.GetPrice();
+            auto* level = asks_.Find(price);
+            DequeueOrder(*level, index);
+            if (!level->HasOrders())
+                asks_.Erase(price);
+        }
+        else
+        {
+            auto price = order.GetPrice();
+            auto* level = bids_.Find(price);
+            DequeueOrder(*level, index);
+            if (!level->HasOrders())
+                bids_.Erase(price);
+        }
+        OnOrderCancelled(order);
+        FreeOrder(index);
+        PublishBBO();
+    }
+
+    // Exposure bookkeeping rides the same lifecycle hooks as the level
+    // aggregates, so the running totals are exact by construction. Open
+    // exposure counts the full remaining quantity, hidden iceberg reserve
+    // included.
+    void ExposureAdd(const Order& order)
+    {
+        if (order.GetOwnerId() == Constants::InvalidParticipant)
+            return;
+        auto& exposure = exposures_[order.GetOwnerId()];
+        ++exposure.orderCount_;
+        exposure.openQuantity_ += order.GetRemainingQuantity();
+        exposure.openNotional_ += static_cast<std::uint64_t>(order.GetPrice()) * order.GetRemainingQuantity();
+    }
+
+    void ExposureReduce(ParticipantId owner, Price price, Quantity quantity, bool removed)
+    {
+        if (owner == Constants::InvalidParticipant)
+            return;
+        const auto it = exposures_.find(owner);
+        if (it == exposures_.end())
+            return;
+        auto& exposure = it->second;
+        exposure.openQuantity_ -= std::min<std::uint64_t>(exposure.openQuantity_, quantity);
+        const auto notional = static_cast<std::uint64_t>(price) * quantity;
+        exposure.openNotional_ -= std::min(exposure.openNotional_, notional);
+        if (removed && exposure.orderCount_ > 0)
+            --exposure.orderCount_;
+    }
+
+    // Admission risk check: prospective exposure against the owner's
+    // limits. No limits registered anywhere, an anonymous order, or an
+    // owner without limits all pass without a map probe beyond the first.
+    bool WithinLimits(const Order& order) const
+    {
+        if (participantLimits_.empty() || order.GetOwnerId() == Constants::InvalidParticipant)
+            return true;
+        const auto limitIt = participantLimits_.find(order.GetOwnerId());
+        if (limitIt == participantLimits_.end())
+            return true;
+        const auto& limits = limitIt->second;
+        ParticipantExposure exposure;
+        if (const auto it = exposures_.find(order.GetOwnerId()); it != exposures_.end())
+            exposure = it->second;
+        const auto quantity = static_cast<std::uint64_t>(order.GetRemainingQuantity());
+        return exposure.orderCount_ + 1 <= limits.maxOrderCount_
+            && exposure.openQuantity_ + quantity <= limits.maxOpenQuantity_
+            && exposure.openNotional_ + static_cast<std::uint64_t>(order.GetPrice()) * quantity <= limits.maxOpenNotional_;
+    }
+
+    void OnOrderCancelled(const Order& order)
+    {
+        UpdateLevelData(order.GetSide(), order.GetPrice(), order.GetVisibleQuantity(), LevelData::Action::Remove);
+        ExposureReduce(order.GetOwnerId(), order.GetPrice(), order.GetRemainingQuantity(), true);
+    }
+    void OnOrderAdded(const Order& order)
+    {
+        UpdateLevelData(order.GetSide(), order.GetPrice(), order.GetVisibleQuantity(), LevelData::Action::Add);
+        ExposureAdd(order);
+    }
+    void OnOrderMatched(const Order& order, Quantity quantity)
+    {
+        UpdateLevelData(order.GetSide(), order.GetPrice(), quantity,
+            order.isFilled() ? LevelData::Action::Remove : LevelData::Action::Match);
+        ExposureReduce(order.GetOwnerId(), order.GetPrice(), quantity, order.isFilled());
+    }
+    // Called under ordersMutex_, so the journal only ever has one writer.
+    void JournalAppend(const OrderCommand& command)
+    {
+        if (journal_)
+            journal_->Append(command);
+    }
+
+    void PublishBBO()
+    {
+        BBO bbo;
+        if (!bids_.Empty())
+            bbo.bid_ = LevelInfo{ bids_.BestPrice(), data_.at(bids_.BestPrice()).quantity_ };
+        if (!asks_.Empty())
+            bbo.ask_ = LevelInfo{ asks_.BestPrice(), data_.at(asks_.BestPrice()).quantity_ };
+
+        BookStats stats;
+        stats.orderCount_ = orders_.Size();
+        stats.bidLevelCount_ = bids_.Size();
+        stats.askLevelCount_ = asks_.Size();
+        std::size_t i = 0;
+        for (const auto& level : bids_)
+        {
+            if (i == BookStats::PublishedDepth)
+                break;
+            stats.bidDepth_[i++] = LevelInfo{ level.price_, data_.at(level.price_).quantity_ };
+        }
+        i = 0;
+        for (const auto& level : asks_)
+        {
+            if (i == BookStats::PublishedDepth)
+                break;
+            stats.askDepth_[i++] = LevelInfo{ level.price_, data_.at(level.price_).quantity_ };
+        }
+
+        // Odd version while the write is in flight; fences keep the payload
+        // stores between the two counter bumps.
+        bboVersion_.store(bboVersion_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        bbo_ = bbo;
+        stats_ = stats;
+        std::atomic_thread_fence(std::memory_order_release);
+        bboVersion_.store(bboVersion_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    // Instrumentation probes. With InstrumentationEnabled false both are
+    // empty inlines and every call site compiles away.
+    static void CountStat(std::atomic<std::uint64_t>& counter, std::uint64_t delta = 1)
+    {
+        if constexpr (InstrumentationEnabled)
+            counter.fetch_add(delta, std::memory_order_relaxed);
+    }
+
+    class ScopedCycles
+    {
+    public:
+        ScopedCycles(std::atomic<std::uint64_t>& calls, std::atomic<std::uint64_t>& cycles)
+            : cycles_{ cycles }
+        {
+            if constexpr (InstrumentationEnabled)
+            {
+                calls.fetch_add(1, std::memory_order_relaxed);
+                start_ = ReadCycleCounter();
+            }
+        }
+        ~ScopedCycles()
+        {
+            if constexpr (InstrumentationEnabled)
+                cycles_.fetch_add(ReadCycleCounter() - start_, std::memory_order_relaxed);
+        }
+        ScopedCycles(const ScopedCycles&) = delete;
+        ScopedCycles& operator=(const ScopedCycles&) = delete;
+    private:
+        std::atomic<std::uint64_t>& cycles_;
+        std::uint64_t start_{ 0 };
+    };
+
+    EventTimestamp ReadEventTimestamp() const
+    {
+        if (timestampSource_ == TimestampSource::CycleCounter)
+            return ReadCycleCounter();
+        return static_cast<EventTimestamp>(
+            std::chrono::steady_clock::now().time_since_epoch().count());
+    }
+
+    SequenceNumber NextSequence()
+    {
+        return eventSequence_.fetch_add(1, std::memory_order_relaxed) + 1;
+    }
+
+    void RecordTrade(Price price, Quantity quantity)
+    {
+        CountStat(statTradesEmitted_);
+        tradedNotional_.fetch_add(static_cast<std::uint64_t>(price) * quantity, std::memory_order_relaxed);
+        tradedVolume_.fetch_add(quantity, std::memory_order_relaxed);
+        lastTradePrice_ = price;
+    }
+
+    // Touch-level churn: prices right at the BBO empty and reopen
+    // constantly, and each round trip through data_ used to cost a node
+    // free followed by a node allocation moments later. Emptied nodes are
+    // parked in a small pool instead and recycled on the next level
+    // creation, so reopening a price near the touch allocates nothing.
+    std::unordered_map<Price, LevelData>::iterator EmplaceLevelData(Price price)
+    {
+        if (!levelDataPool_.empty())
+        {
+            auto node = std::move(levelDataPool_.back());
+            levelDataPool_.pop_back();
+            node.key() = price;
+            node.mapped() = LevelData{ };
+            return data_.insert(std::move(node)).position;
+        }
+        return data_.emplace(price, LevelData{ }).first;
+    }
+
+    void RetireLevelData(std::unordered_map<Price, LevelData>::iterator it)
+    {
+        if (levelDataPool_.size() < LevelDataPoolDepth)
+            levelDataPool_.push_back(data_.extract(it));
+        else
+            data_.erase(it);
+    }
+
+    void UpdateLevelData(Side side, Price price, Quantity quantity, LevelData::Action action)
+    {
+        auto it = data_.find(price);
+        if (it == data_.end())
+            it = EmplaceLevelData(price);
+        auto& data = it->second;
+        data.count_ += action == LevelData::Action::Remove ? -1 : action == LevelData::Action::Add ? 1 : 0;
+        if (action == LevelData::Action::Remove || action == LevelData::Action::Match)
+        {
+            data.quantity_ -= quantity;
+        }
+        else
+        {
+            data.quantity_ += quantity;
+        }
+        const Quantity aggregate = data.quantity_;
+        if (data.count_ == 0)
+            RetireLevelData(it);
+
+        // Per-side open-quantity totals ride the same delta; relaxed atomics
+        // because UpdateLevelData only ever runs under ordersMutex_.
+        auto& openQuantity = side == Side::Buy ? bidOpenQuantity_ : askOpenQuantity_;
+        if (action == LevelData::Action::Add || action == LevelData::Action::Replenish)
+            openQuantity.fetch_add(quantity, std::memory_order_relaxed);
+        else
+            openQuantity.fetch_sub(quantity, std::memory_order_relaxed);
+
+        // The sequence ticks even with no subscriber attached so replays
+        // assign the same numbers regardless of who was listening.
+        const SequenceNumber sequence = NextSequence();
+        if (marketDataQueue_ &&
+            !marketDataQueue_->TryPush(
+                LevelUpdate{ side, action, price, aggregate, sequence, ReadEventTimestamp() }))
+            droppedMarketDataUpdates_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // FillOrKill feasibility: walk the opposite ladder best-to-worst, in
+    // price order, and stop at the first level beyond the limit — only the
+    // levels that would actually fill are touched, instead of every level
+    // on both sides in hash order.
+    bool CanFullyFill(Side side, Price price, Quantity quantity) const
+    {
+        if (!CanMatch(side, price))
+            return false;
+
+        if (side == Side::Buy)
+        {
+            for (const auto& level : asks_)
+            {
+                if (level.price_ > price)
+                    break;
+                const Quantity available = data_.at(level.price_).quantity_;
+                if (quantity <= available)
+                    return true;
+                quantity -= available;
+            }
+        }
+        else
+        {
+            for (const auto& level : bids_)
+            {
+                if (level.price_ < price)
+                    break;
+                const Quantity available = data_.at(level.price_).quantity_;
+                if (quantity <= available)
+                    return true;
+                quantity -= available;
+            }
+        }
+        return false;
+    }
+
+    bool CanMatch(Side side, Price price) const
+    {
+        if (side == Side::Buy)
+        {
+            if (asks_.Empty())
+                return false; // cant match
+            return price >= asks_.BestPrice();
+        }
+        else
+        {
+            if (bids_.Empty())
+                return false; // cant match
+            return price <= bids_.BestPrice();
+        }
+    }
+
+    // Removes a resting order from its level mid-match without erasing the
+    // level itself, so the references the match loop holds stay valid; the
+    // loop reaps emptied levels afterwards.
+    void RemoveOrderAt(Level& level, OrderIndex index)
+    {
+        const auto& order = OrderAt(index);
+        DequeueOrder(level, index);
+        orders_.Erase(order.GetOrderId());
+        OnOrderCancelled(order);
+        FreeOrder(index);
+    }
+
+    // Shrinks a resting order in place, charging the level aggregate only
+    // for the visible delta (the whole delta for regular orders).
+    void ReduceRestingOrder(Order& order, Quantity newQuantity)
+    {
+        const Quantity visibleBefore = order.GetVisibleQuantity();
+        const Quantity remainingBefore = order.GetRemainingQuantity();
+        order.ReduceQuantityTo(newQuantity);
+        const Quantity delta = visibleBefore - order.GetVisibleQuantity();
+        if (delta > 0)
+            UpdateLevelData(order.GetSide(), order.GetPrice(), delta, LevelData::Action::Match);
+        ExposureReduce(order.GetOwnerId(), order.GetPrice(),
+            remainingBefore - order.GetRemainingQuantity(), false);
+    }
+
+    // Self-trade resolution, run inside the match loop where both orders
+    // are already in cache — no snapshot or pre-submit scan needed.
+    void ResolveSelfTrade(Level& bidLevel, Level& askLevel, OrderIndex bidIndex, OrderIndex askIndex)
+    {
+        auto& bid = OrderAt(bidIndex);
+        auto& ask = OrderAt(askIndex);
+        switch (selfTradePolicy_)
+        {
+        case SelfTradePolicy::CancelNewest:
+        case SelfTradePolicy::CancelOldest:
+        {
+            // Order ids are assigned monotonically upstream, so the larger
+            // id is the newer order.
+            const bool cancelBid = (bid.GetOrderId() > ask.GetOrderId())
+                == (selfTradePolicy_ == SelfTradePolicy::CancelNewest);
+            if (cancelBid)
+                RemoveOrderAt(bidLevel, bidIndex);
+            else
+                RemoveOrderAt(askLevel, askIndex);
+            break;
+        }
+        case SelfTradePolicy::DecrementAndCancel:
+        {
+            // The smaller order is cancelled and the larger one shrinks by
+            // its quantity; equal sizes cancel both.
+            const Quantity bidQuantity = bid.GetRemainingQuantity();
+            const Quantity askQuantity = ask.GetRemainingQuantity();
+            if (bidQuantity > askQuantity)
+            {
+                ReduceRestingOrder(bid, bidQuantity - askQuantity);
+                RemoveOrderAt(askLevel, askIndex);
+            }
+            else if (askQuantity > bidQuantity)
+            {
+                ReduceRestingOrder(ask, askQuantity - bidQuantity);
+                RemoveOrderAt(bidLevel, bidIndex);
+            }
+            else
+            {
+                RemoveOrderAt(bidLevel, bidIndex);
+                RemoveOrderAt(askLevel, askIndex);
+            }
+            break;
+        }
+        case SelfTradePolicy::None:
+            break;
+        }
+    }
+
+    // Market sweep: consumes the opposite side best-first with no price
+    // comparison. Bounded by SetMarketOrderBounds so one fat-finger order
+    // cannot walk a deep book while holding ordersMutex_; any quantity
+    // still open when a bound trips (or the book empties) is dropped,
+    // immediate-or-cancel style.
+    template <typename EmitTrade>
+    void ExecuteMarketOrderInto(Order order, EmitTrade&& emit)
+    {
+        const Side side = order.GetSide();
+        const Side restingSide = side == Side::Buy ? Side::Sell : Side::Buy;
+        auto sweep = [&](auto& levels)
+        {
+            Price firstPrice = Constants::InvalidPrice;
+            std::uint32_t levelsSwept = 0;
+            while (!order.isFilled() && !levels.Empty())
+            {
+                auto& level = levels.Best();
+                if (firstPrice == Constants::InvalidPrice)
+                    firstPrice = level.price_;
+                if (levelsSwept >= maxMarketSweepLevels_)
+                    break;
+                const Price slippage = level.price_ > firstPrice
+                    ? level.price_ - firstPrice
+                    : firstPrice - level.price_;
+                if (maxMarketSlippage_ != Constants::InvalidPrice && slippage > maxMarketSlippage_)
+                    break;
+                ++levelsSwept;
+                CountStat(statLevelsSwept_);
+
+                while (!order.isFilled() && level.HasOrders())
+                {
+                    const OrderIndex restingIndex = level.head_;
+                    auto& resting = OrderAt(restingIndex);
+
+                    if (selfTradePolicy_ != SelfTradePolicy::None
+                        && resting.GetOwnerId() == order.GetOwnerId()
+                        && resting.GetOwnerId() != Constants::InvalidParticipant)
+                    {
+                        // The in-flight market order is always the newer one.
+                        if (selfTradePolicy_ == SelfTradePolicy::CancelNewest)
+                            return; // drop the market remainder
+                        if (selfTradePolicy_ == SelfTradePolicy::DecrementAndCancel
+                            && resting.GetRemainingQuantity() > order.GetRemainingQuantity())
+                        {
+                            ReduceRestingOrder(resting, resting.GetRemainingQuantity() - order.GetRemainingQuantity());
+                            return;
+                        }
+                        // CancelOldest, or a decrement that consumes the
+                        // smaller resting order entirely.
+                        if (selfTradePolicy_ == SelfTradePolicy::DecrementAndCancel)
+                            order.Fill(resting.GetRemainingQuantity());
+                        RemoveOrderAt(level, restingIndex);
+                        continue;
+                    }
+
+                    const Quantity quantity = std::min(order.GetRemainingQuantity(), resting.GetVisibleQuantity());
+                    order.Fill(quantity);
+                    resting.Fill(quantity);
+                    if (resting.isFilled())
+                    {
+                        DequeueOrder(level, restingIndex);
+                        orders_.Erase(resting.GetOrderId());
+                    }
+                    const TradeInfo takerInfo{ order.GetOrderId(), resting.GetPrice(), quantity };
+                    const TradeInfo makerInfo{ resting.GetOrderId(), resting.GetPrice(), quantity };
+                    const SequenceNumber sequence = NextSequence();
+                    const EventTimestamp timestamp = ReadEventTimestamp();
+                    emit(side == Side::Buy
+                        ? Trade{ takerInfo, makerInfo, sequence, timestamp }
+                        : Trade{ makerInfo, takerInfo, sequence, timestamp });
+                    RecordTrade(resting.GetPrice(), quantity);
+                    // Only the resting side lives in the level aggregates;
+                    // the market order never rested.
+                    OnOrderMatched(resting, quantity);
+                    if (!resting.isFilled() && resting.GetVisibleQuantity() == 0)
+                        UpdateLevelData(restingSide, resting.GetPrice(), resting.Replenish(), LevelData::Action::Replenish);
+                    if (resting.isFilled())
+                        FreeOrder(restingIndex);
+                }
+                if (!level.HasOrders())
+                    levels.EraseBest();
+            }
+        };
+        if (side == Side::Buy)
+            sweep(asks_);
+        else
+            sweep(bids_);
+        PublishBBO();
+    }
+
+    // Core matching loop: emits each Trade into the supplied sink as it
+    // happens, so the hot path never builds (or sizes) a Trades vector.
+    // Stop activation and FillAndKill cleanup live in MatchOrdersInto so
+    // this core can be re-entered from the stop-activation fixed-point
+    // loop without recursing.
+    template <typename EmitTrade>
+    void MatchCoreInto(EmitTrade&& emit)
+    {
+        ScopedCycles matchProbe{ statMatchCalls_, statMatchCycles_ };
+        while(true)
+        {
+            if (bids_.Empty() || asks_.Empty())
+                break;
+
+            auto& bidLevel = bids_.Best();
+            auto& askLevel = asks_.Best();
+
+            if (bidLevel.price_ < askLevel.price_)
+                break;
+
+            while (bidLevel.HasOrders() && askLevel.HasOrders())
+            {
+                const OrderIndex bidIndex = bidLevel.head_;
+                const OrderIndex askIndex = askLevel.head_;
+                auto& bid = OrderAt(bidIndex);
+                auto& ask = OrderAt(askIndex);
+
+                if (selfTradePolicy_ != SelfTradePolicy::None
+                    && bid.GetOwnerId() == ask.GetOwnerId()
+                    && bid.GetOwnerId() != Constants::InvalidParticipant)
+                {
+                    ResolveSelfTrade(bidLevel, askLevel, bidIndex, askIndex);
+                    continue; // no trade; re-evaluate the level heads
+                }
+
+                Quantity quantity = std::min(bid.GetVisibleQuantity(), ask.GetVisibleQuantity());
+                bid.Fill(quantity);
+                ask.Fill(quantity);
+
+                if (bid.isFilled())
+                {
+                    DequeueOrder(bidLevel, bidIndex);
+                    orders_.Erase(bid.GetOrderId());
+                }
+                if (ask.isFilled())
+                {
+                    DequeueOrder(askLevel, askIndex);
+                    orders_.Erase(ask.GetOrderId());
+                }
+
+                emit(Trade{
+                    TradeInfo{ bid.GetOrderId(), bid.GetPrice(), quantity},
+                    TradeInfo{ ask.GetOrderId(), ask.GetPrice(), quantity},
+                    NextSequence(), ReadEventTimestamp()
+                });
+
+                // The older (smaller-id) order was the resting one, so its
+                // price is the execution price on the tape.
+                RecordTrade(bid.GetOrderId() < ask.GetOrderId() ? bid.GetPrice() : ask.GetPrice(), quantity);
+
+                OnOrderMatched(bid, quantity);
+                OnOrderMatched(ask, quantity);
+
+                // Iceberg replenishment: an in-place field update, keeping
+                // queue position; only the redisplayed slice hits the level
+                // aggregate.
+                if (!bid.isFilled() && bid.GetVisibleQuantity() == 0)
+                    UpdateLevelData(Side::Buy, bid.GetPrice(), bid.Replenish(), LevelData::Action::Replenish);
+                if (!ask.isFilled() && ask.GetVisibleQuantity() == 0)
+                    UpdateLevelData(Side::Sell, ask.GetPrice(), ask.Replenish(), LevelData::Action::Replenish);
+
+                if (bid.isFilled())
+                    FreeOrder(bidIndex);
+                if (ask.isFilled())
+                    FreeOrder(askIndex);
+            }
+            if (!bidLevel.HasOrders())
+            {
+                bids_.EraseBest();
+                CountStat(statLevelsSwept_);
+            }
+            if (!askLevel.HasOrders())
+            {
+                asks_.EraseBest();
+                CountStat(statLevelsSwept_);
+            }
+        }
+    }
+
+    // Pops the first order off the best level of a stop ladder, returning
+    // it by value so the slab slot can be recycled before activation.
+    template <typename StopLevels>
+    Order PopStop(StopLevels& stops)
+    {
+        auto& level = stops.Best();
+        const OrderIndex index = level.head_;
+        const Order order = OrderAt(index);
+        DequeueOrder(level, index);
+        orders_.Erase(order.GetOrderId());
+        FreeOrder(index);
+        if (!level.HasOrders())
+            stops.EraseBest();
+        return order;
+    }
+
+    bool StopTriggered(Side side, Price stopPrice) const
+    {
+        if (lastTradePrice_ == Constants::InvalidPrice)
+            return false;
+        return side == Side::Buy ? lastTradePrice_ >= stopPrice : lastTradePrice_ <= stopPrice;
+    }
+
+    // Fires every stop whose price the tape has printed through, inside
+    // the same matching cycle. Activations can print new trades that fire
+    // further stops, so this loops to a fixed point; it owns all
+    // re-matching itself (via MatchCoreInto / the market sweep) and is
+    // never called from inside them, keeping the recursion depth flat no
+    // matter how long the stop cascade is.
+    template <typename EmitTrade>
+    void ActivateTriggeredStopsInto(EmitTrade&& emit)
+    {
+        while (true)
+        {
+            Order pending{ OrderType::Stop, 0, Side::Buy, 0, 0 };
+            if (!buyStops_.Empty() && StopTriggered(Side::Buy, buyStops_.BestPrice()))
+                pending = PopStop(buyStops_);
+            else if (!sellStops_.Empty() && StopTriggered(Side::Sell, sellStops_.BestPrice()))
+                pending = PopStop(sellStops_);
+            else
+                return;
+
+            if (pending.GetOrderType() == OrderType::Stop)
+            {
+                ExecuteMarketOrderInto(Order{ OrderType::Market, pending.GetOrderId(), pending.GetSide(),
+                    Constants::InvalidPrice, pending.GetRemainingQuantity(), pending.GetOwnerId() }, emit);
+            }
+            else
+            {
+                pending.ToGoodTillCancel(pending.GetPrice());
+                if (StageOrder(pending))
+                    MatchCoreInto(emit);
+            }
+        }
+    }
+
+    template <typename EmitTrade>
+    void MatchOrdersInto(EmitTrade&& emit)
+    {
+        MatchCoreInto(emit);
+        ActivateTriggeredStopsInto(emit);
+        if (!bids_.Empty())
+        {
+            auto& order = OrderAt(bids_.Best().head_);
+            if (order.GetOrderType() == OrderType::FillAndKill)
+                CancelOrderInternal(order.GetOrderId());
+        }
+        if (!asks_.Empty())
+        {
+            auto& order = OrderAt(asks_.Best().head_);
+            if (order.GetOrderType() == OrderType::FillAndKill)
+                CancelOrderInternal(order.GetOrderId());
+        }
+        PublishBBO();
+    }
+
+    Trades MatchOrders()
+    {
+        Trades trades;
+        MatchOrdersInto([&trades](const Trade& trade) { trades.push_back(trade); });
+        return trades;
+    }
+
+    Trades AddOrderInternal(Order order, std::optional<std::chrono::system_clock::time_point> expiry = std::nullopt)
+    {
+        if (order.GetOrderType() == OrderType::Market)
+        {
+            Trades trades;
+            auto sink = [&trades](const Trade& trade) { trades.push_back(trade); };
+            ExecuteMarketOrderInto(order, sink);
+            ActivateTriggeredStopsInto(sink);
+            PublishBBO();
+            return trades;
+        }
+        if (order.GetOrderType() == OrderType::Stop || order.GetOrderType() == OrderType::StopLimit)
+            return AddStopOrderInternal(order);
+        if (!StageOrder(order, expiry))
+            return { };
+        return MatchOrders(); // run matching algorithm
+    }
+
+    // Parks a stop in its trigger ladder, or activates it immediately if
+    // the tape has already printed through the stop price.
+    Trades AddStopOrderInternal(Order order)
+    {
+        // Only the stop entry points set a trigger price; a Stop/StopLimit
+        // arriving through the generic AddOrder has none, and InvalidPrice
+        // would read as already-triggered on one side and never-triggered
+        // on the other. Reject it instead of guessing.
+        if (order.GetStopPrice() == Constants::InvalidPrice)
+            return { };
+        if (orders_.Contains(order.GetOrderId()))
+            return { };
+        if (StopTriggered(order.GetSide(), order.GetStopPrice()))
+        {
+            if (order.GetOrderType() == OrderType::Stop)
+                return AddOrderInternal(Order{ OrderType::Market, order.GetOrderId(), order.GetSide(),
+                    Constants::InvalidPrice, order.GetRemainingQuantity(), order.GetOwnerId() });
+            order.ToGoodTillCancel(order.GetPrice());
+            return AddOrderInternal(order);
+        }
+        const OrderIndex index = AllocateOrder(order);
+        auto& level = order.GetSide() == Side::Buy
+            ? buyStops_.GetOrCreate(order.GetStopPrice())
+            : sellStops_.GetOrCreate(order.GetStopPrice());
+        EnqueueOrder(level, index);
+        orders_.Insert(order.GetOrderId(), index);
+        PublishBBO(); // keeps the published order count in step
+        return { };
+    }
+
+    // Admission checks plus book insertion without running the matcher, so
+    // batched entry can stage a whole packet of orders and match once.
+    bool StageOrder(Order order, std::optional<std::chrono::system_clock::time_point> expiry = std::nullopt)
+    {
+        if (order.GetOrderType() == OrderType::Market)
+            return false; // market orders never rest; see ExecuteMarketOrderInto
+        if (orders_.Contains(order.GetOrderId()))
+            return false;
+        // Untriggered stops live in the trigger ladders, not the book; they
+        // re-enter here as GoodTillCancel once ActivateTriggeredStopsInto
+        // converts them.
+        if (order.GetOrderType() == OrderType::Stop || order.GetOrderType() == OrderType::StopLimit)
+            return false;
+        if (order.GetOrderType() == OrderType::FillAndKill && !CanMatch(order.GetSide(), order.GetPrice()))
+        {
+            if (order.GetSide() == Side::Buy && !asks_.Empty())
+                order.ToGoodTillCancel(asks_.WorstPrice());
+            else if (order.GetSide() == Side::Sell && !bids_.Empty())
+                order.ToGoodTillCancel(bids_.WorstPrice());
+            else
+                return false;
+            CountStat(statFakReprices_);
+        }
+        if (order.GetOrderType() == OrderType::FillAndKill && !CanMatch(order.GetSide(), order.GetPrice()))
+            return false;
+        if (order.GetOrderType() == OrderType::FillOrKill && !CanFullyFill(order.GetSide(), order.GetPrice(), order.GetInitialQuantity()))
+            return false;
+        // Last so the check sees the final price (FillAndKill may have
+        // repriced above).
+        if (!WithinLimits(order))
+            return false;
+
+        RestOrder(order);
+
+        if (!expiry && order.GetOrderType() == OrderType::GoodForDay)
+            expiry = NextGoodForDayExpiry();
+        if (expiry)
+            RegisterExpiry(*expiry, order.GetOrderId());
+        return true;
+    }
+
+    // Compile-time specialized staging: each OrderType instantiation is
+    // straight-line code carrying only the checks that type needs, so the
+    // dominant GoodTillCancel flow compiles without the FillAndKill
+    // repricing or FillOrKill feasibility branches.
+    template <OrderType Type>
+    bool StageOrderTyped(Order order)
+    {
+        if (orders_.Contains(order.GetOrderId()))
+            return false;
+
+        if constexpr (Type == OrderType::FillAndKill)
+        {
+            if (!CanMatch(order.GetSide(), order.GetPrice()))
+            {
+                if (order.GetSide() == Side::Buy && !asks_.Empty())
+                    order.ToGoodTillCancel(asks_.WorstPrice());
+                else if (order.GetSide() == Side::Sell && !bids_.Empty())
+                    order.ToGoodTillCancel(bids_.WorstPrice());
+                else
+                    return false;
+                CountStat(statFakReprices_);
+            }
+            if (!CanMatch(order.GetSide(), order.GetPrice()))
+                return false;
+        }
+        if constexpr (Type == OrderType::FillOrKill)
+        {
+            if (!CanFullyFill(order.GetSide(), order.GetPrice(), order.GetInitialQuantity()))
+                return false;
+        }
+        if (!WithinLimits(order))
+            return false;
+
+        RestOrder(order);
+
+        if constexpr (Type == OrderType::GoodForDay)
+            RegisterExpiry(NextGoodForDayExpiry(), order.GetOrderId());
+        return true;
+    }
+
+    // Common tail of every staging path: pooled slot, level FIFO, id index.
+    void RestOrder(const Order& order)
+    {
+        const OrderIndex index = AllocateOrder(order);
+        auto& level = order.GetSide() == Side::Buy
+            ? bids_.GetOrCreate(order.GetPrice())
+            : asks_.GetOrCreate(order.GetPrice());
+        EnqueueOrder(level, index);
+        orders_.Insert(order.GetOrderId(), index);
+        OnOrderAdded(OrderAt(index));
+    }
+
+    void RegisterExpiry(std::chrono::system_clock::time_point expiry, OrderId orderId)
+    {
+        const bool newEarliest = expiries_.empty() || expiry < expiries_.begin()->first;
+        expiries_.emplace(expiry, orderId);
+        if (newEarliest)
+            shutdownConditionVariable_.notify_one(); // prune thread re-arms
+    }
+
+    void RunMatchingThread()
+    {
+        OrderCommand command;
+        while (true)
+        {
+            if (!commandQueue_->TryPop(command))
+            {
+                // Drain everything submitted before StopAsync before exiting.
+                if (!asyncRunning_.load(std::memory_order_acquire))
+                    return;
+                std::this_thread::yield();
+                continue;
+            }
+
+            Trades trades;
+            switch (command.type_)
+            {
+                case OrderCommand::Type::Add:
+                    trades = AddOrder(command.orderType_, command.orderId_, command.side_, command.price_, command.quantity_);
+                    break;
+                case OrderCommand::Type::Cancel:
+                    CancelOrder(command.orderId_);
+                    break;
+                case OrderCommand::Type::Modify:
+                    trades = ModifyOrder(OrderModify{ command.orderId_, command.side_, command.price_, command.quantity_ });
+                    break;
+            }
+            if (tradeHandler_ && !trades.empty())
+                tradeHandler_(trades);
+        }
+    }
+
+public:
+    Orderbook(): Orderbook(true) { }
+
+    // An engine that runs its own timer service constructs books without the
+    // per-book prune thread and drives CancelGoodForDayOrders itself.
+    explicit Orderbook(bool pruneGoodForDay)
+    {
+        if (pruneGoodForDay)
+            ordersPruneThread_ = std::thread{ [this] { PruneGoodForDayOrders(); } };
+    }
+
+    ~Orderbook()
+    {
+        {
+            // Flip the flag under the lock so the prune thread can't slip
+            // between its shutdown check and its wait and miss the notify.
+            std::scoped_lock ordersLock{ ordersMutex_ };
+            shutdown_.store(true, std::memory_order_release);
+        }
+        shutdownConditionVariable_.notify_one();
+        if (ordersPruneThread_.joinable())
+            ordersPruneThread_.join();
+        StopAsync();
+    }
+
+    // Cancels exactly the orders whose expiry is due, straight off the
+    // expiry index — no scan of orders_ and no touching of unrelated book
+    // state. Called by the prune thread or an external timer service.
+    void CancelExpiredOrders(std::chrono::system_clock::time_point due)
+    {
+        OrderIds orderIds;
+        {
+            std::scoped_lock ordersLock{ ordersMutex_ };
+            const auto end = expiries_.upper_bound(due);
+            for (auto it = expiries_.begin(); it != end; ++it)
+                if (orders_.Contains(it->second)) // skip filled/cancelled entries
+                    orderIds.push_back(it->second);
+            expiries_.erase(expiries_.begin(), end);
+        }
+        CancelOrders(orderIds);
+    }
+
+    // Good-For-Day orders are indexed at the 16:00 cutoff, so expiring
+    // everything due now is exactly the old prune behaviour.
+    void CancelGoodForDayOrders()
+    {
+        CancelExpiredOrders(std::chrono::system_clock::now());
+    }
+
+    // Asynchronous submission mode: a single gateway thread posts commands
+    // into a lock-free ring drained by a dedicated matching thread, so order
+    // entry never contends on ordersMutex_ and never waits on matching.
+    // Trades are delivered to the handler from the matching thread.
+    void StartAsync(TradeHandler handler, std::size_t queueCapacity = 1 << 16)
+    {
+        if (asyncRunning_.exchange(true, std::memory_order_acq_rel))
+            return;
+        commandQueue_ = std::make_unique<SPSCQueue<OrderCommand>>(queueCapacity);
+        tradeHandler_ = std::move(handler);
+        matchingThread_ = std::thread{ [this] { RunMatchingThread(); } };
+    }
+
+    void StopAsync()
+    {
+        if (!asyncRunning_.exchange(false, std::memory_order_acq_rel))
+            return;
+        matchingThread_.join();
+    }
+
+    // Producer-side entry points; return false when the ring is full so the
+    // gateway can apply backpressure instead of blocking.
+    bool SubmitOrder(OrderType orderType, OrderId orderId, Side side, Price price, Quantity quantity)
+    {
+        return commandQueue_->TryPush(OrderCommand{ OrderCommand::Type::Add, orderType, orderId, side, price, quantity });
+    }
+
+    bool SubmitCancel(OrderId orderId)
+    {
+        return commandQueue_->TryPush(OrderCommand{ OrderCommand::Type::Cancel, { }, orderId, { }, { }, { } });
+    }
+
+    bool SubmitModify(const OrderModify& order)
+    {
+        return commandQueue_->TryPush(OrderCommand{ OrderCommand::Type::Modify, { }, order.GetOrderId(), order.GetSide(), order.GetPrice(), order.GetQuantity() });
+    }
+
+    Trades AddOrder(OrderPointer order)
+    {
+        std::scoped_lock ordersLock{ ordersMutex_};
+        JournalAppend(OrderCommand{ OrderCommand::Type::Add, order->GetOrderType(), order->GetOrderId(),
+            order->GetSide(), order->GetPrice(), order->GetInitialQuantity(),
+            order->GetOwnerId(), order->GetDisplayQuantity(), order->GetStopPrice() });
+        return AddOrderInternal(*order);
+    }
+
+    // Pooled entry point: constructs the order directly in the slab, so the
+    // caller never pays a make_shared per submission. Orders submitted with
+    // an owner id participate in self-trade prevention.
+    Trades AddOrder(OrderType orderType, OrderId orderId, Side side, Price price, Quantity quantity,
+        ParticipantId ownerId = Constants::InvalidParticipant)
+    {
+        std::scoped_lock ordersLock{ ordersMutex_ };
+        ScopedCycles lockProbe{ statLockAcquisitions_, statLockHoldCycles_ };
+        ScopedCycles addProbe{ statAddCalls_, statAddCycles_ };
+        JournalAppend(OrderCommand{ OrderCommand::Type::Add, orderType, orderId, side, price, quantity, ownerId });
+        return AddOrderInternal(Order{ orderType, orderId, side, price, quantity, ownerId });
+    }
+
+    // Iceberg entry point: only `displayQuantity` rests visibly; the hidden
+    // remainder replenishes the visible slice in place as it fills, keeping
+    // queue position — no cancel+add round trip per slice.
+    Trades AddIcebergOrder(OrderId orderId, Side side, Price price, Quantity quantity, Quantity displayQuantity,
+        ParticipantId ownerId = Constants::InvalidParticipant)
+    {
+        std::scoped_lock ordersLock{ ordersMutex_ };
+        JournalAppend(OrderCommand{ OrderCommand::Type::Add, OrderType::GoodTillCancel, orderId, side, price,
+            quantity, ownerId, displayQuantity });
+        return AddOrderInternal(Order{ OrderType::GoodTillCancel, orderId, side, price, quantity, ownerId, displayQuantity });
+    }
+
+    // Compile-time specialized entry point for callers that know the order
+    // type at the call site, e.g. AddOrder<OrderType::GoodTillCancel>(...).
+    // The dynamic overload above stays for mixed-type callers.
+    template <OrderType Type>
+    Trades AddOrder(OrderId orderId, Side side, Price price, Quantity quantity)
+    {
+        static_assert(Type != OrderType::Market, "market orders carry no price; use the dynamic AddOrder");
+        static_assert(Type != OrderType::Stop && Type != OrderType::StopLimit,
+            "stops live in the trigger ladders; use AddStopOrder/AddStopLimitOrder");
+        std::scoped_lock ordersLock{ ordersMutex_ };
+        ScopedCycles lockProbe{ statLockAcquisitions_, statLockHoldCycles_ };
+        ScopedCycles addProbe{ statAddCalls_, statAddCycles_ };
+        JournalAppend(OrderCommand{ OrderCommand::Type::Add, Type, orderId, side, price, quantity });
+        if (!StageOrderTyped<Type>(Order{ Type, orderId, side, price, quantity }))
+            return { };
+        return MatchOrders();
+    }
+
+    // Stop entry points: the order rests hidden in a price-indexed trigger
+    // ladder and enters the book — inside the same matching cycle — once
+    // the tape prints through its stop price. A plain stop activates as a
+    // market order, a stop-limit as a GoodTillCancel at `limitPrice`.
+    Trades AddStopOrder(OrderId orderId, Side side, Price stopPrice, Quantity quantity,
+        ParticipantId ownerId = Constants::InvalidParticipant)
+    {
+        std::scoped_lock ordersLock{ ordersMutex_ };
+        JournalAppend(OrderCommand{ OrderCommand::Type::Add, OrderType::Stop, orderId, side,
+            Constants::InvalidPrice, quantity, ownerId, 0, stopPrice });
+        Order order{ OrderType::Stop, orderId, side, Constants::InvalidPrice, quantity, ownerId };
+        order.SetStopPrice(stopPrice);
+        return AddStopOrderInternal(order);
+    }
+
+    Trades AddStopLimitOrder(OrderId orderId, Side side, Price stopPrice, Price limitPrice, Quantity quantity,
+        ParticipantId ownerId = Constants::InvalidParticipant)
+    {
+        std::scoped_lock ordersLock{ ordersMutex_ };
+        JournalAppend(OrderCommand{ OrderCommand::Type::Add, OrderType::StopLimit, orderId, side,
+            limitPrice, quantity, ownerId, 0, stopPrice });
+        Order order{ OrderType::StopLimit, orderId, side, limitPrice, quantity, ownerId };
+        order.SetStopPrice(stopPrice);
+        return AddStopOrderInternal(order);
+    }
+
+    // Entry point for orders carrying their own expiry timestamp; the prune
+    // thread cancels them when the timestamp comes due.
+    Trades AddOrder(OrderType orderType, OrderId orderId, Side side, Price price, Quantity quantity,
+        std::chrono::system_clock::time_point expiry)
+    {
+        std::scoped_lock ordersLock{ ordersMutex_ };
+        JournalAppend(OrderCommand{ OrderCommand::Type::Add, orderType, orderId, side, price, quantity,
+            Constants::InvalidParticipant, 0, Constants::InvalidPrice,
+            std::chrono::duration_cast<std::chrono::nanoseconds>(expiry.time_since_epoch()).count() });
+        return AddOrderInternal(Order{ orderType, orderId, side, price, quantity }, expiry);
+    }
+
+    // Trade-sink entry points: trades are emitted record by record into a
+    // caller-supplied preallocated ring (or callback) as they happen, so the
+    // hot path allocates nothing. Returns false if the order was rejected.
+    bool AddOrder(OrderType orderType, OrderId orderId, Side side, Price price, Quantity quantity,
+        SPSCQueue<Trade>& tradeSink)
+    {
+        std::scoped_lock ordersLock{ ordersMutex_ };
+        JournalAppend(OrderCommand{ OrderCommand::Type::Add, orderType, orderId, side, price, quantity });
+        if (!StageOrder(Order{ orderType, orderId, side, price, quantity }))
+            return false;
+        MatchOrdersInto([&tradeSink](const Trade& trade)
+        {
+            // The consumer copies trades out immediately; spin rather than
+            // drop on a momentarily full ring.
+            while (!tradeSink.TryPush(trade))
+                std::this_thread::yield();
+        });
+        return true;
+    }
+
+    bool AddOrder(OrderType orderType, OrderId orderId, Side side, Price price, Quantity quantity,
+        const std::function<void(const Trade&)>& tradeSink)
+    {
+        std::scoped_lock ordersLock{ ordersMutex_ };
+        JournalAppend(OrderCommand{ OrderCommand::Type::Add, orderType, orderId, side, price, quantity });
+        if (!StageOrder(Order{ orderType, orderId, side, price, quantity }))
+            return false;
+        MatchOrdersInto(tradeSink);
+        return true;
+    }
+
+    // Batched entry: stages every order in the packet under one lock
+    // acquisition and runs the matcher once at the end, instead of paying
+    // lock + lookup + match per order.
+    Trades AddOrders(std::span<const OrderPointer> orders)
+    {
+        std::scoped_lock ordersLock{ ordersMutex_ };
+        Trades trades;
+        auto sink = [&trades](const Trade& trade) { trades.push_back(trade); };
+        for (const auto& order : orders)
+        {
+            JournalAppend(OrderCommand{ OrderCommand::Type::Add, order->GetOrderType(), order->GetOrderId(),
+                order->GetSide(), order->GetPrice(), order->GetInitialQuantity(),
+                order->GetOwnerId(), order->GetDisplayQuantity(), order->GetStopPrice() });
+            if (order->GetOrderType() == OrderType::Market)
+                ExecuteMarketOrderInto(*order, sink);
+            else
+                StageOrder(*order);
+        }
+        MatchOrdersInto(sink);
+        return trades;
+    }
+
+    Trades AddOrders(std::span<const Order> orders)
+    {
+        std::scoped_lock ordersLock{ ordersMutex_ };
+        Trades trades;
+        auto sink = [&trades](const Trade& trade) { trades.push_back(trade); };
+        for (const auto& order : orders)
+        {
+            JournalAppend(OrderCommand{ OrderCommand::Type::Add, order.GetOrderType(), order.GetOrderId(),
+                order.GetSide(), order.GetPrice(), order.GetInitialQuantity(),
+                order.GetOwnerId(), order.GetDisplayQuantity(), order.GetStopPrice() });
+            if (order.GetOrderType() == OrderType::Market)
+                ExecuteMarketOrderInto(order, sink);
+            else
+                StageOrder(order);
+        }
+        MatchOrdersInto(sink);
+        return trades;
+    }
+
+    void CancelOrder(OrderId orderId)
+    {
+        std::scoped_lock ordersLock{ ordersMutex_ };
+        ScopedCycles lockProbe{ statLockAcquisitions_, statLockHoldCycles_ };
+        ScopedCycles cancelProbe{ statCancelCalls_, statCancelCycles_ };
+        JournalAppend(OrderCommand{ OrderCommand::Type::Cancel, { }, orderId, { }, { }, { } });
+        CancelOrderInternal(orderId);
+    }
+
+    // Batched cancel path: one lock acquisition for a whole packet of
+    // cancels. Also used by the GFD prune thread.
+    void CancelOrders(OrderIds orderIds)
+    {
+        std::scoped_lock ordersLock{ ordersMutex_ };
+
+        for (const auto& orderId : orderIds)
+        {
+            JournalAppend(OrderCommand{ OrderCommand::Type::Cancel, { }, orderId, { }, { }, { } });
+            CancelOrderInternal(orderId);
+        }
+    }
+
+    Trades ModifyOrder(OrderModify order)
+    {
+        std::scoped_lock ordersLock{ ordersMutex_ };
+        JournalAppend(OrderCommand{ OrderCommand::Type::Modify, { }, order.GetOrderId(),
+            order.GetSide(), order.GetPrice(), order.GetQuantity() });
+
+        const OrderIndex index = orders_.Find(order.GetOrderId());
+        if (index == Constants::InvalidOrderIndex)
+            return { };
+        auto& existing = OrderAt(index);
+
+        // A modify down to nothing is just a cancel.
+        if (order.GetQuantity() == 0)
+        {
+            CancelOrderInternal(order.GetOrderId());
+            return { };
+        }
+
+        const OrderType orderType = existing.GetOrderType();
+        const bool isStop = orderType == OrderType::Stop || orderType == OrderType::StopLimit;
+
+        // Fast path: same side and price with the quantity shrinking is an
+        // in-place update — the order keeps its position in the level queue
+        // and only the level aggregate moves. Untriggered stops sit in the
+        // trigger ladders and never touched the level aggregates, so they
+        // skip this and rebuild through the stop staging path below.
+        if (!isStop && existing.GetSide() == order.GetSide() && existing.GetPrice() == order.GetPrice() &&
+            order.GetQuantity() <= existing.GetRemainingQuantity())
+        {
+            if (order.GetQuantity() == existing.GetRemainingQuantity())
+                return { };
+            ReduceRestingOrder(existing, order.GetQuantity());
+            PublishBBO();
+            return { };
+        }
+
+        if (orderType != OrderType::GoodTillCancel && orderType != OrderType::GoodForDay)
+        {
+            // FillAndKill repricing, FillOrKill feasibility and the stop
+            // ladders all live in the staging paths, so those types go
+            // through cancel-and-re-add; the replacement carries the cold
+            // fields over so a modify no longer drops the owner, display
+            // setting or trigger price.
+            const Quantity display = existing.GetDisplayQuantity();
+            const Order replacement{ orderType, order.GetOrderId(), order.GetSide(), order.GetPrice(),
+                order.GetQuantity(), order.GetQuantity(),
+                display == 0 ? order.GetQuantity() : std::min(display, order.GetQuantity()),
+                display, existing.GetStopPrice(), existing.GetOwnerId() };
+            CancelOrderInternal(order.GetOrderId());
+            return AddOrderInternal(replacement);
+        }
+
+        // Price change or quantity increase on a resting order: rewrite the
+        // slot in place and relink it at the tail of its new level. The
+        // slab slot, its id-table entry and the cold fields all survive, so
+        // against cancel-and-re-add this saves two id-table updates and a
+        // free-list round trip.
+        auto unlink = [&](auto& levels)
+        {
+            const Price price = existing.GetPrice();
+            auto* level = levels.Find(price);
+            DequeueOrder(*level, index);
+            if (!level->HasOrders())
+                levels.Erase(price);
+        };
+        if (existing.GetSide() == Side::Buy)
+            unlink(bids_);
+        else
+            unlink(asks_);
+        OnOrderCancelled(existing); // releases the level aggregate and exposure
+        existing.Rewrite(order.GetSide(), order.GetPrice(), order.GetQuantity());
+        if (!WithinLimits(existing))
+        {
+            // Mirrors cancel-and-re-add: a modify the owner's limits cannot
+            // absorb cancels the order.
+            orders_.Erase(order.GetOrderId());
+            FreeOrder(index);
+            PublishBBO();
+            return { };
+        }
+        auto& level = order.GetSide() == Side::Buy
+            ? bids_.GetOrCreate(order.GetPrice())
+            : asks_.GetOrCreate(order.GetPrice());
+        EnqueueOrder(level, index);
+        OnOrderAdded(existing);
+        return MatchOrders();
+    }
+
+    // Subscribes a consumer-owned queue to the delta stream. The queue must
+    // outlive the subscription; pass nullptr to unsubscribe.
+    void SubscribeMarketData(SPSCQueue<LevelUpdate>* queue)
+    {
+        std::scoped_lock ordersLock{ ordersMutex_ };
+        marketDataQueue_ = queue;
+    }
+
+    std::uint64_t GetDroppedMarketDataUpdates() const
+    {
+        return droppedMarketDataUpdates_.load(std::memory_order_relaxed);
+    }
+
+    // Self-trade prevention applies to orders whose owners were set via the
+    // owner-aware AddOrder overload; anonymous orders always trade.
+    void SetSelfTradePolicy(SelfTradePolicy policy)
+    {
+        std::scoped_lock ordersLock{ ordersMutex_ };
+        selfTradePolicy_ = policy;
+    }
+
+    SelfTradePolicy GetSelfTradePolicy() const
+    {
+        std::scoped_lock ordersLock{ ordersMutex_ };
+        return selfTradePolicy_;
+    }
+
+    // Registers (or replaces) admission limits for a participant: once the
+    // owner's running exposure plus a new order would breach any limit,
+    // that order is rejected before it touches the book. Orders from
+    // owners without limits, and anonymous orders, are never checked.
+    void SetParticipantLimits(ParticipantId participant, const ParticipantLimits& limits)
+    {
+        std::scoped_lock ordersLock{ ordersMutex_ };
+        participantLimits_[participant] = limits;
+    }
+
+    void ClearParticipantLimits(ParticipantId participant)
+    {
+        std::scoped_lock ordersLock{ ordersMutex_ };
+        participantLimits_.erase(participant);
+    }
+
+    ParticipantExposure GetParticipantExposure(ParticipantId participant) const
+    {
+        std::scoped_lock ordersLock{ ordersMutex_ };
+        const auto it = exposures_.find(participant);
+        return it != exposures_.end() ? it->second : ParticipantExposure{ };
+    }
+
+    // Selects the clock stamped onto trades and level updates; see
+    // TimestampSource for the trade-off.
+    void SetTimestampSource(TimestampSource source)
+    {
+        std::scoped_lock ordersLock{ ordersMutex_ };
+        timestampSource_ = source;
+    }
+
+    // Sequence of the most recently stamped event; consumers merging the
+    // trade and level-update streams can detect drops against this.
+    SequenceNumber GetEventSequence() const
+    {
+        return eventSequence_.load(std::memory_order_relaxed);
+    }
+
+    // Scrape-friendly snapshot of the instrumentation counters; all zero
+    // when ORDERBOOK_INSTRUMENTATION is off (except the order-table resize
+    // count, which is always kept).
+    HotPathStats GetHotPathStats() const
+    {
+        HotPathStats stats;
+        stats.addCalls_ = statAddCalls_.load(std::memory_order_relaxed);
+        stats.addCycles_ = statAddCycles_.load(std::memory_order_relaxed);
+        stats.cancelCalls_ = statCancelCalls_.load(std::memory_order_relaxed);
+        stats.cancelCycles_ = statCancelCycles_.load(std::memory_order_relaxed);
+        stats.matchCalls_ = statMatchCalls_.load(std::memory_order_relaxed);
+        stats.matchCycles_ = statMatchCycles_.load(std::memory_order_relaxed);
+        stats.lockAcquisitions_ = statLockAcquisitions_.load(std::memory_order_relaxed);
+        stats.lockHoldCycles_ = statLockHoldCycles_.load(std::memory_order_relaxed);
+        stats.tradesEmitted_ = statTradesEmitted_.load(std::memory_order_relaxed);
+        stats.levelsSwept_ = statLevelsSwept_.load(std::memory_order_relaxed);
+        stats.fakReprices_ = statFakReprices_.load(std::memory_order_relaxed);
+        stats.orderTableResizes_ = orders_.ResizeCount();
+        return stats;
+    }
+
+    // Caps a market-order sweep at maxLevels price levels and at
+    // maxSlippage away from the first level it touched; pass
+    // Constants::InvalidPrice to leave slippage unbounded.
+    void SetMarketOrderBounds(std::uint32_t maxLevels, Price maxSlippage)
+    {
+        std::scoped_lock ordersLock{ ordersMutex_ };
+        maxMarketSweepLevels_ = maxLevels;
+        maxMarketSlippage_ = maxSlippage;
+    }
+
+    // Every subsequent add/cancel/modify is appended to the journal at
+    // `path` until CloseJournal (or destruction) flushes and closes it.
+    void OpenJournal(const std::string& path)
+    {
+        std::scoped_lock ordersLock{ ordersMutex_ };
+        journal_ = std::make_unique<OrderJournal>(path);
+    }
+
+    void CloseJournal()
+    {
+        std::scoped_lock ordersLock{ ordersMutex_ };
+        journal_.reset();
+    }
+
+    // Writes a binary image of the whole book — resting orders level by
+    // level, stop ladders, tape state, and the expiry index — so a restart
+    // can cold-start from the image instead of replaying a day of flow.
+    bool SaveSnapshot(const std::string& path) const
+    {
+        std::scoped_lock ordersLock{ ordersMutex_ };
+        std::FILE* file = std::fopen(path.c_str(), "wb");
+        if (!file)
+            return false;
+
+        const BookSnapshot::Header header{ BookSnapshot::Magic, BookSnapshot::Version };
+        std::fwrite(&header, sizeof(header), 1, file);
+        const BookSnapshot::TapeRecord tape{ lastTradePrice_,
+            tradedNotional_.load(std::memory_order_relaxed), tradedVolume_.load(std::memory_order_relaxed) };
+        std::fwrite(&tape, sizeof(tape), 1, file);
+
+        auto writeSide = [&](const auto& levels)
+        {
+            const auto levelCount = static_cast<std::uint32_t>(levels.Size());
+            std::fwrite(&levelCount, sizeof(levelCount), 1, file);
+            for (const auto& level : levels) // best to worst
+            {
+                std::uint32_t orderCount = 0;
+                for (OrderIndex index = level.head_; index != Constants::InvalidOrderIndex;
+                    index = OrderAt(index).GetNext())
+                    ++orderCount;
+                const BookSnapshot::LevelRecord levelRecord{ level.price_, orderCount };
+                std::fwrite(&levelRecord, sizeof(levelRecord), 1, file);
+                for (OrderIndex index = level.head_; index != Constants::InvalidOrderIndex;
+                    index = OrderAt(index).GetNext())
+                {
+                    const Order& order = OrderAt(index);
+                    const BookSnapshot::OrderRecord record{ order.GetOrderType(), order.GetOrderId(),
+                        order.GetSide(), order.GetPrice(), order.GetInitialQuantity(),
+                        order.GetRemainingQuantity(), order.GetVisibleQuantity(),
+                        order.GetDisplayQuantity(), order.GetStopPrice(), order.GetOwnerId() };
+                    std::fwrite(&record, sizeof(record), 1, file);
+                }
+            }
+        };
+        writeSide(bids_);
+        writeSide(asks_);
+        writeSide(buyStops_);
+        writeSide(sellStops_);
+
+        const auto expiryCount = static_cast<std::uint32_t>(expiries_.size());
+        std::fwrite(&expiryCount, sizeof(expiryCount), 1, file);
+        for (const auto& [expiry, orderId] : expiries_)
+        {
+            const BookSnapshot::ExpiryRecord record{
+                std::chrono::duration_cast<std::chrono::nanoseconds>(expiry.time_since_epoch()).count(), orderId };
+            std::fwrite(&record, sizeof(record), 1, file);
+        }
+
+        const bool ok = std::fflush(file) == 0;
+        std::fclose(file);
+        return ok;
+    }
+
+    // Bulk-reconstructs the book from a SaveSnapshot image: levels are
+    // appended to the ladders in sorted order (worst first, so every insert
+    // lands at the back) and orders go straight into the slab — no
+    // per-order matching or repricing runs. Replaces any current state.
+    bool LoadSnapshot(const std::string& path)
+    {
+        const int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+        struct stat fileInfo;
+        if (::fstat(fd, &fileInfo) != 0 || static_cast<std::size_t>(fileInfo.st_size) < sizeof(BookSnapshot::Header))
+        {
+            ::close(fd);
+            return false;
+        }
+        void* mapped = ::mmap(nullptr, fileInfo.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (mapped == MAP_FAILED)
+            return false;
+
+        const auto* cursor = static_cast<const std::byte*>(mapped);
+        // Records are copied out rather than referenced in place: the
+        // 4-byte expiry count leaves ExpiryRecord (alignof 8) at a
+        // misaligned offset, so binding a reference there is UB.
+        auto read = [&cursor]<typename T>(std::type_identity<T>) -> T
+        {
+            T value;
+            std::memcpy(&value, cursor, sizeof(T));
+            cursor += sizeof(T);
+            return value;
+        };
+
+        const auto& header = read(std::type_identity<BookSnapshot::Header>{ });
+        if (header.magic_ != BookSnapshot::Magic || header.version_ != BookSnapshot::Version)
+        {
+            ::munmap(mapped, fileInfo.st_size);
+            return false;
+        }
+
+        // Dry-run the whole record walk against the mapped size before any
+        // state is touched: the embedded level/order/expiry counts come
+        // from the file, and trusting them on a truncated or corrupt image
+        // would clear the book and then run the cursor past the mapping.
+        {
+            const std::byte* const end = static_cast<const std::byte*>(mapped) + fileInfo.st_size;
+            const std::byte* probe = cursor;
+            // Same copy-out convention as the read lambda below; the probe
+            // must not bind references at misaligned offsets either.
+            auto next = [&]<typename T>(std::type_identity<T>) -> std::optional<T>
+            {
+                if (static_cast<std::size_t>(end - probe) < sizeof(T))
+                    return std::nullopt;
+                T value;
+                std::memcpy(&value, probe, sizeof(T));
+                probe += sizeof(T);
+                return value;
+            };
+            bool valid = next(std::type_identity<BookSnapshot::TapeRecord>{ }).has_value();
+            for (int side = 0; valid && side < 4; ++side)
+            {
+                const auto levelCount = next(std::type_identity<std::uint32_t>{ });
+                valid = levelCount.has_value();
+                for (std::uint32_t i = 0; valid && i < *levelCount; ++i)
+                {
+                    const auto level = next(std::type_identity<BookSnapshot::LevelRecord>{ });
+                    const auto orderBytes = level
+                        ? static_cast<std::size_t>(level->orderCount_) * sizeof(BookSnapshot::OrderRecord)
+                        : 0;
+                    valid = level.has_value() && static_cast<std::size_t>(end - probe) >= orderBytes;
+                    if (valid)
+                        probe += orderBytes;
+                }
+            }
+            if (valid)
+            {
+                const auto expiryCount = next(std::type_identity<std::uint32_t>{ });
+                valid = expiryCount.has_value()
+                    && static_cast<std::size_t>(end - probe)
+                        >= static_cast<std::size_t>(*expiryCount) * sizeof(BookSnapshot::ExpiryRecord);
+            }
+            if (!valid)
+            {
+                ::munmap(mapped, fileInfo.st_size);
+                return false;
+            }
+        }
+
+        std::scoped_lock ordersLock{ ordersMutex_ };
+        bids_ = { };
+        asks_ = { };
+        buyStops_ = { };
+        sellStops_ = { };
+        slab_.clear();
+        freeList_ = Constants::InvalidOrderIndex;
+        orders_ = { };
+        data_.clear();
+        exposures_.clear(); // rebuilt by OnOrderAdded as levels reload
+        expiries_.clear();
+        bidOpenQuantity_.store(0, std::memory_order_relaxed);
+        askOpenQuantity_.store(0, std::memory_order_relaxed);
+
+        const auto& tape = read(std::type_identity<BookSnapshot::TapeRecord>{ });
+        lastTradePrice_ = tape.lastTradePrice_;
+        tradedNotional_.store(tape.tradedNotional_, std::memory_order_relaxed);
+        tradedVolume_.store(tape.tradedVolume_, std::memory_order_relaxed);
+
+        auto readSide = [&](auto& levels, bool book)
+        {
+            // Collect the level spans first, then build worst-to-best so
+            // each GetOrCreate appends at the back of the sorted vector.
+            const auto levelCount = read(std::type_identity<std::uint32_t>{ });
+            std::vector<std::pair<BookSnapshot::LevelRecord, const BookSnapshot::OrderRecord*>> spans;
+            spans.reserve(levelCount);
+            for (std::uint32_t i = 0; i < levelCount; ++i)
+            {
+                const auto& levelRecord = read(std::type_identity<BookSnapshot::LevelRecord>{ });
+                spans.emplace_back(levelRecord, reinterpret_cast<const BookSnapshot::OrderRecord*>(cursor));
+                cursor += levelRecord.orderCount_ * sizeof(BookSnapshot::OrderRecord);
+            }
+            for (auto it = spans.rbegin(); it != spans.rend(); ++it)
+            {
+                auto& level = levels.GetOrCreate(it->first.price_);
+                for (std::uint32_t i = 0; i < it->first.orderCount_; ++i)
+                {
+                    const auto& record = it->second[i];
+                    const OrderIndex index = AllocateOrder(Order{ record.orderType_, record.orderId_,
+                        record.side_, record.price_, record.initialQuantity_, record.remainingQuantity_,
+                        record.visibleQuantity_, record.displayQuantity_, record.stopPrice_, record.ownerId_ });
+                    EnqueueOrder(level, index);
+                    orders_.Insert(record.orderId_, index);
+                    if (book)
+                        OnOrderAdded(OrderAt(index));
+                }
+            }
+        };
+        readSide(bids_, true);
+        readSide(asks_, true);
+        readSide(buyStops_, false);
+        readSide(sellStops_, false);
+
+        const auto expiryCount = read(std::type_identity<std::uint32_t>{ });
+        for (std::uint32_t i = 0; i < expiryCount; ++i)
+        {
+            const auto& record = read(std::type_identity<BookSnapshot::ExpiryRecord>{ });
+            expiries_.emplace(std::chrono::system_clock::time_point{
+                std::chrono::duration_cast<std::chrono::system_clock::duration>(
+                    std::chrono::nanoseconds{ record.expiryNanos_ }) }, record.orderId_);
+        }
+        if (!expiries_.empty())
+            shutdownConditionVariable_.notify_one(); // prune thread re-arms
+
+        ::munmap(mapped, fileInfo.st_size);
+        PublishBBO();
+        return true;
+    }
+
+    // Wait-free for readers: polls the published aggregates instead of
+    // taking ordersMutex_, so 100Hz dashboards no longer jitter matching.
+    std::size_t Size() const
+    {
+        return GetStats().orderCount_;
+    }
+
+    BookStats GetStats() const
+    {
+        while (true)
+        {
+            const auto before = bboVersion_.load(std::memory_order_acquire);
+            if (before & 1)
+                continue; // write in flight
+            const BookStats stats = stats_;
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (bboVersion_.load(std::memory_order_relaxed) == before)
+                return stats;
+        }
+    }
+
+    // Lock-free top-of-book reads: spin on the seqlock version counter until
+    // a consistent copy is observed. Safe to call from any thread at any
+    // rate without disturbing the matching thread.
+    BBO GetBBO() const
+    {
+        while (true)
+        {
+            const auto before = bboVersion_.load(std::memory_order_acquire);
+            if (before & 1)
+                continue; // write in flight
+            const BBO bbo = bbo_;
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (bboVersion_.load(std::memory_order_relaxed) == before)
+                return bbo;
+        }
+    }
+
+    LevelInfo GetBestBid() const { return GetBBO().bid_; }
+    LevelInfo GetBestAsk() const { return GetBBO().ask_; }
+
+    std::optional<Price> GetSpread() const
+    {
+        const auto bbo = GetBBO();
+        if (!bbo.HasBid() || !bbo.HasAsk())
+            return std::nullopt;
+        return bbo.ask_.price_ - bbo.bid_.price_;
+    }
+
+    // Volume-weighted average trade price, cumulative since construction
+    // or the last ResetVwap. Callers wanting a rolling window sample and
+    // difference the sums themselves; the write path stays O(1).
+    double GetVwap() const
+    {
+        const auto volume = tradedVolume_.load(std::memory_order_relaxed);
+        if (volume == 0)
+            return 0.0;
+        return static_cast<double>(tradedNotional_.load(std::memory_order_relaxed)) / static_cast<double>(volume);
+    }
+
+    void ResetVwap()
+    {
+        tradedNotional_.store(0, std::memory_order_relaxed);
+        tradedVolume_.store(0, std::memory_order_relaxed);
+    }
+
+    // Signed (bid - ask) / (bid + ask) over all open quantity; +1 means a
+    // pure-bid book. Maintained as running per-side totals in
+    // UpdateLevelData, so the read is two atomic loads.
+    double GetBookImbalance() const
+    {
+        const auto bid = static_cast<double>(bidOpenQuantity_.load(std::memory_order_relaxed));
+        const auto ask = static_cast<double>(askOpenQuantity_.load(std::memory_order_relaxed));
+        if (bid + ask == 0.0)
+            return 0.0;
+        return (bid - ask) / (bid + ask);
+    }
+
+    // The same ratio restricted to the top `depth` levels per side (at
+    // most BookStats::PublishedDepth), read from the seqlock-published
+    // stats instead of walking the ladders.
+    double GetDepthImbalance(std::size_t depth = BookStats::PublishedDepth) const
+    {
+        const BookStats stats = GetStats();
+        double bid = 0.0;
+        double ask = 0.0;
+        for (std::size_t i = 0; i < std::min({ depth, BookStats::PublishedDepth, stats.bidLevelCount_ }); ++i)
+            bid += stats.bidDepth_[i].quantity_;
+        for (std::size_t i = 0; i < std::min({ depth, BookStats::PublishedDepth, stats.askLevelCount_ }); ++i)
+            ask += stats.askDepth_[i].quantity_;
+        if (bid + ask == 0.0)
+            return 0.0;
+        return (bid - ask) / (bid + ask);
+    }
+
+    // Quantity-weighted mid from the published BBO — the fair-value point
+    // between the touch prices, leaning toward the thinner side.
+    std::optional<double> GetMicroprice() const
+    {
+        const auto bbo = GetBBO();
+        if (!bbo.HasBid() || !bbo.HasAsk())
+            return std::nullopt;
+        const auto bidQuantity = static_cast<double>(bbo.bid_.quantity_);
+        const auto askQuantity = static_cast<double>(bbo.ask_.quantity_);
+        if (bidQuantity + askQuantity == 0.0)
+            return std::nullopt;
+        return (bbo.bid_.price_ * askQuantity + bbo.ask_.price_ * bidQuantity) / (bidQuantity + askQuantity);
+    }
+
+    OrderbookLevelInfos GetOrderInfos() const
+    {
+        std::scoped_lock ordersLock{ ordersMutex_ };
+
+        // The per-level aggregates in data_ are maintained on every add,
+        // cancel and match, so a snapshot is one copy per level — no walking
+        // of resting orders. The buffers keep their capacity across calls.
+        bidInfosBuffer_.clear();
+        askInfosBuffer_.clear();
+        bidInfosBuffer_.reserve(bids_.Size());
+        askInfosBuffer_.reserve(asks_.Size());
+
+        for (const auto& level : bids_)
+            bidInfosBuffer_.push_back(LevelInfo{ level.price_, data_.at(level.price_).quantity_ });
+        for (const auto& level : asks_)
+            askInfosBuffer_.push_back(LevelInfo{ level.price_, data_.at(level.price_).quantity_ });
+
+        return OrderbookLevelInfos(bidInfosBuffer_, askInfosBuffer_);
+    }
+};
+
+// Memory-mapped journal replay: streams fixed-size records straight into
+// the matching core through the pooled AddOrder path — no per-order
+// make_shared, no parsing — so a book rebuilds at memory-bandwidth speed.
+// Returns the number of records applied, or -1 if the file is missing or
+// malformed.
+long ReplayJournal(const std::string& path, Orderbook& orderbook)
+{
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return -1;
+
+    struct stat fileInfo;
+    if (::fstat(fd, &fileInfo) != 0 || static_cast<std::size_t>(fileInfo.st_size) < sizeof(OrderJournal::Header))
+    {
+        ::close(fd);
+        return -1;
+    }
+
+    void* mapped = ::mmap(nullptr, fileInfo.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mapped == MAP_FAILED)
+        return -1;
+
+    const auto* header = static_cast<const OrderJournal::Header*>(mapped);
+    if (header->magic_ != OrderJournal::Magic || header->version_ != OrderJournal::Version)
+    {
+        ::munmap(mapped, fileInfo.st_size);
+        return -1;
+    }
+
+    const auto* records = reinterpret_cast<const OrderCommand*>(header + 1);
+    const long count = (fileInfo.st_size - sizeof(OrderJournal::Header)) / sizeof(OrderCommand);
+
+    for (long i = 0; i < count; ++i)
+    {
+        const auto& command = records[i];
+        switch (command.type_)
+        {
+            case OrderCommand::Type::Add:
+                if (command.orderType_ == OrderType::Stop)
+                    orderbook.AddStopOrder(command.orderId_, command.side_, command.stopPrice_, command.quantity_, command.ownerId_);
+                else if (command.orderType_ == OrderType::StopLimit)
+                    orderbook.AddStopLimitOrder(command.orderId_, command.side_, command.stopPrice_, command.price_,
+                        command.quantity_, command.ownerId_);
+                else if (command.displayQuantity_ != 0)
+                    orderbook.AddIcebergOrder(command.orderId_, command.side_, command.price_, command.quantity_,
+                        command.displayQuantity_, command.ownerId_);
+                else if (command.expiryNanos_ != 0)
+                    orderbook.AddOrder(command.orderType_, command.orderId_, command.side_, command.price_,
+                        command.quantity_, std::chrono::system_clock::time_point{
+                            std::chrono::duration_cast<std::chrono::system_clock::duration>(
+                                std::chrono::nanoseconds{ command.expiryNanos_ }) });
+                else
+                    orderbook.AddOrder(command.orderType_, command.orderId_, command.side_, command.price_, command.quantity_, command.ownerId_);
+                break;
+            case OrderCommand::Type::Cancel:
+                orderbook.CancelOrder(command.orderId_);
+                break;
+            case OrderCommand::Type::Modify:
+                orderbook.ModifyOrder(OrderModify{ command.orderId_, command.side_, command.price_, command.quantity_ });
+                break;
+        }
+    }
+
+    ::munmap(mapped, fileInfo.st_size);
+    return count;
+}
+
+// Owns one Orderbook per listed symbol and shards them across a fixed pool
+// of matching threads. Sharding is symbol-affine (hash of the symbol), so
+// each book is only ever driven by one thread, and a single shared timer
+// service replaces the per-book Good-For-Day prune threads.
+class OrderbookEngine
+{
+public:
+    using TradeHandler = std::function<void(const Symbol&, const Trades&)>;
+
+    explicit OrderbookEngine(std::size_t matchingThreadCount = std::thread::hardware_concurrency())
+    {
+        shards_.reserve(std::max<std::size_t>(matchingThreadCount, 1));
+        for (std::size_t i = 0; i < std::max<std::size_t>(matchingThreadCount, 1); ++i)
+            shards_.push_back(std::make_unique<Shard>());
+        for (auto& shard : shards_)
+            shard->worker_ = std::thread{ [this, &shard = *shard] { RunShard(shard); } };
+        timerThread_ = std::thread{ [this] { RunTimerService(); } };
+    }
+
+    ~OrderbookEngine()
+    {
+        {
+            std::scoped_lock timerLock{ timerMutex_ };
+            running_.store(false, std::memory_order_release);
+        }
+        timerCondition_.notify_one();
+        timerThread_.join();
+        for (auto& shard : shards_)
+            shard->worker_.join();
+    }
+
+    // Must be called before submissions start; trades are delivered from the
+    // owning shard's matching thread.
+    void SetTradeHandler(TradeHandler handler)
+    {
+        tradeHandler_ = std::move(handler);
+    }
+
+    Orderbook& AddBook(const Symbol& symbol)
+    {
+        std::scoped_lock booksLock{ booksMutex_ };
+        auto& entry = books_[symbol];
+        if (!entry.book_)
+        {
+            entry.book_ = std::make_unique<Orderbook>(false); // no per-book prune thread
+            entry.shard_ = std::hash<Symbol>{ }(symbol) % shards_.size();
+        }
+        return *entry.book_;
+    }
+
+    Orderbook* GetBook(const Symbol& symbol)
+    {
+        std::scoped_lock booksLock{ booksMutex_ };
+        auto it = books_.find(symbol);
+        return it == books_.end() ? nullptr : it->second.book_.get();
+    }
+
+    bool SubmitOrder(const Symbol& symbol, OrderType orderType, OrderId orderId, Side side, Price price, Quantity quantity)
+    {
+        return Submit(symbol, OrderCommand{ OrderCommand::Type::Add, orderType, orderId, side, price, quantity });
+    }
+
+    bool SubmitCancel(const Symbol& symbol, OrderId orderId)
+    {
+        return Submit(symbol, OrderCommand{ OrderCommand::Type::Cancel, { }, orderId, { }, { }, { } });
+    }
+
+    bool SubmitModify(const Symbol& symbol, const OrderModify& order)
+    {
+        return Submit(symbol, OrderCommand{ OrderCommand::Type::Modify, { }, order.GetOrderId(), order.GetSide(), order.GetPrice(), order.GetQuantity() });
+    }
+
+private:
+    struct EngineCommand
+    {
+        Orderbook* book_;
+        const Symbol* symbol_;
+        OrderCommand command_;
+    };
+
+    struct Shard
+    {
+        SPSCQueue<EngineCommand> queue_{ 1 << 16 };
+        std::thread worker_;
+    };
+
+    struct BookEntry
+    {
+        std::unique_ptr<Orderbook> book_;
+        std::size_t shard_{ };
+    };
+
+    bool Submit(const Symbol& symbol, const OrderCommand& command)
+    {
+        Orderbook* book;
+        const Symbol* key;
+        std::size_t shard;
+        {
+            std::scoped_lock booksLock{ booksMutex_ };
+            auto it = books_.find(symbol);
+            if (it == books_.end())
+                return false;
+            book = it->second.book_.get();
+            key = &it->first;
+            shard = it->second.shard_;
+        }
+        return shards_[shard]->queue_.TryPush(EngineCommand{ book, key, command });
+    }
+
+    void RunShard(Shard& shard)
+    {
+        EngineCommand command;
+        while (true)
+        {
+            if (!shard.queue_.TryPop(command))
+            {
+                // Drain everything already submitted before exiting.
+                if (!running_.load(std::memory_order_acquire))
+                    return;
+                std::this_thread::yield();
+                continue;
+            }
+
+            Trades trades;
+            switch (command.command_.type_)
+            {
+                case OrderCommand::Type::Add:
+                    trades = command.book_->AddOrder(command.command_.orderType_, command.command_.orderId_,
+                        command.command_.side_, command.command_.price_, command.command_.quantity_);
+                    break;
+                case OrderCommand::Type::Cancel:
+                    command.book_->CancelOrder(command.command_.orderId_);
+                    break;
+                case OrderCommand::Type::Modify:
+                    trades = command.book_->ModifyOrder(OrderModify{ command.command_.orderId_,
+                        command.command_.side_, command.command_.price_, command.command_.quantity_ });
+                    break;
+            }
+            if (tradeHandler_ && !trades.empty())
+                tradeHandler_(*command.symbol_, trades);
+        }
+    }
+
+    // One timer for the whole engine: wakes at the 16:00 cutoff and expires
+    // Good-For-Day orders across every book.
+    void RunTimerService()
+    {
+        using namespace std::chrono;
+        while (true)
+        {
+            const auto till = NextGoodForDayExpiry() - system_clock::now() + milliseconds(100);
+            {
+                std::unique_lock timerLock{ timerMutex_ };
+                if (timerCondition_.wait_for(timerLock, till,
+                        [this] { return !running_.load(std::memory_order_acquire); }))
+                    return;
+            }
+            std::scoped_lock booksLock{ booksMutex_ };
+            for (auto& [_, entry] : books_)
+                entry.book_->CancelGoodForDayOrders();
+        }
+    }
+
+    std::unordered_map<Symbol, BookEntry> books_;
+    mutable std::mutex booksMutex_;
+    std::vector<std::unique_ptr<Shard>> shards_;
+    TradeHandler tradeHandler_;
+    std::atomic<bool> running_{ true };
+    std::mutex timerMutex_;
+    std::condition_variable timerCondition_;
+    std::thread timerThread_;
+};
+
+// ---------------------------------------------------------------------------
+// Benchmark harness (run with --bench): generates configurable
+// pseudo-realistic order flow and drives the book at max rate, reporting
+// throughput and latency percentiles per operation type. Arrivals are
+// generated Poisson-style but not paced — the point is to saturate the
+// book, not to simulate wall-clock gaps.
+// ---------------------------------------------------------------------------
+
+struct BenchConfig
+{
+    std::uint64_t operations = 1'000'000;
+    std::uint64_t seed = 42;
+    // Operation mix, normalized at construction.
+    double addWeight = 0.55;
+    double cancelWeight = 0.25;
+    double modifyWeight = 0.15;
+    double marketWeight = 0.05;
+    Price midPrice = 10'000;
+    // Geometric level-offset parameter: higher means flow concentrates
+    // harder at the touch, with a power-law-like tail into the depth.
+    double levelDecay = 0.25;
+    // Share of adds priced through the mid onto the opposite side, so
+    // limit flow actually crosses and the core match loop is exercised —
+    // passive-only flow would leave all matching to the market-order mix.
+    double aggressiveShare = 0.10;
+};
+
+class OrderFlowGenerator
+{
+public:
+    enum class OpKind { Add, Cancel, Modify, Market };
+
+    struct Op
+    {
+        OpKind kind_;
+        OrderCommand command_;
+    };
+
+    explicit OrderFlowGenerator(const BenchConfig& config)
+        : config_{ config }
+        , rng_{ config.seed }
+        , levelOffset_{ config.levelDecay }
+        , quantity_{ 1, 100 }
+    {
+        const double total = config.addWeight + config.cancelWeight + config.modifyWeight + config.marketWeight;
+        addThreshold_ = config.addWeight / total;
+        cancelThreshold_ = addThreshold_ + config.cancelWeight / total;
+        modifyThreshold_ = cancelThreshold_ + config.modifyWeight / total;
+    }
+
+    Op Next()
+    {
+        const double roll = roll_(rng_);
+        if (roll < addThreshold_ || live_.empty())
+            return NextAdd();
+        if (roll < cancelThreshold_)
+            return NextCancel();
+        if (roll < modifyThreshold_)
+            return NextModify();
+        return NextMarket();
+    }
+
+private:
+    struct LiveOrder
+    {
+        OrderId orderId_;
+        Side side_;
+        Price price_;
+    };
+
+    Op NextAdd()
+    {
+        const Side side = roll_(rng_) < 0.5 ? Side::Buy : Side::Sell;
+        const Price offset = 1 + static_cast<Price>(levelOffset_(rng_));
+        // Aggressive adds price through the mid and fill against resting
+        // depth; passive adds build it.
+        const bool aggressive = roll_(rng_) < config_.aggressiveShare;
+        const Price price = (side == Side::Buy) == aggressive
+            ? config_.midPrice + offset
+            : config_.midPrice - offset;
+        const OrderId orderId = nextOrderId_++;
+        live_.push_back(LiveOrder{ orderId, side, price });
+        return Op{ OpKind::Add, OrderCommand{ OrderCommand::Type::Add, OrderType::GoodTillCancel,
+            orderId, side, price, quantity_(rng_) } };
+    }
+
+    Op NextCancel()
+    {
+        const LiveOrder order = TakeRandomLive();
+        return Op{ OpKind::Cancel, OrderCommand{ OrderCommand::Type::Cancel, { },
+            order.orderId_, order.side_, order.price_, 0 } };
+    }
+
+    Op NextModify()
+    {
+        // Resize in place; the book's fast path keeps queue position when
+        // the quantity shrinks, so both modify paths get exercised.
+        const std::size_t slot = static_cast<std::size_t>(roll_(rng_) * live_.size());
+        const LiveOrder& order = live_[std::min(slot, live_.size() - 1)];
+        return Op{ OpKind::Modify, OrderCommand{ OrderCommand::Type::Modify, { },
+            order.orderId_, order.side_, order.price_, quantity_(rng_) } };
+    }
+
+    Op NextMarket()
+    {
+        const Side side = roll_(rng_) < 0.5 ? Side::Buy : Side::Sell;
+        return Op{ OpKind::Market, OrderCommand{ OrderCommand::Type::Add, OrderType::Market,
+            nextOrderId_++, side, Constants::InvalidPrice, quantity_(rng_) } };
+    }
+
+    LiveOrder TakeRandomLive()
+    {
+        const std::size_t slot = std::min(static_cast<std::size_t>(roll_(rng_) * live_.size()), live_.size() - 1);
+        const LiveOrder order = live_[slot];
+        live_[slot] = live_.back();
+        live_.pop_back();
+        return order;
+    }
+
+    BenchConfig config_;
+    std::mt19937_64 rng_;
+    std::uniform_real_distribution<double> roll_{ 0.0, 1.0 };
+    std::geometric_distribution<Price> levelOffset_;
+    std::uniform_int_distribution<Quantity> quantity_;
+    double addThreshold_;
+    double cancelThreshold_;
+    double modifyThreshold_;
+    std::vector<LiveOrder> live_;
+    OrderId nextOrderId_ = 1;
+};
+
+std::uint64_t BenchPercentile(std::vector<std::uint64_t>& samples, double quantile)
+{
+    if (samples.empty())
+        return 0;
+    const auto rank = static_cast<std::size_t>(quantile * (samples.size() - 1));
+    std::nth_element(samples.begin(), samples.begin() + rank, samples.end());
+    return samples[rank];
+}
+
+void BenchReport(const char* name, std::vector<std::uint64_t>& nanos)
+{
+    std::cout << name << ": count=" << nanos.size()
+        << " p50=" << BenchPercentile(nanos, 0.50) << "ns"
+        << " p99=" << BenchPercentile(nanos, 0.99) << "ns"
+        << " p99.9=" << BenchPercentile(nanos, 0.999) << "ns\n";
+}
+
+int RunBenchmark(int argc, char* argv[])
+{
+    BenchConfig config;
+    for (int i = 0; i + 1 < argc; i += 2)
+    {
+        const std::string flag = argv[i];
+        const std::string value = argv[i + 1];
+        if (flag == "--ops")
+            config.operations = std::stoull(value);
+        else if (flag == "--seed")
+            config.seed = std::stoull(value);
+        else if (flag == "--adds")
+            config.addWeight = std::stod(value);
+        else if (flag == "--cancels")
+            config.cancelWeight = std::stod(value);
+        else if (flag == "--modifies")
+            config.modifyWeight = std::stod(value);
+        else if (flag == "--markets")
+            config.marketWeight = std::stod(value);
+        else if (flag == "--decay")
+            config.levelDecay = std::stod(value);
+        else if (flag == "--aggressive")
+            config.aggressiveShare = std::stod(value);
+        else
+        {
+            std::cout << "unknown flag " << flag << "\n";
+            return 1;
+        }
+    }
+
+    // Pre-generate the flow so generator cost stays out of the timed loop.
+    OrderFlowGenerator generator{ config };
+    std::vector<OrderFlowGenerator::Op> ops;
+    ops.reserve(config.operations);
+    for (std::uint64_t i = 0; i < config.operations; ++i)
+        ops.push_back(generator.Next());
+
+    Orderbook orderbook{ false };
+    std::array<std::vector<std::uint64_t>, 4> latencies;
+    for (auto& samples : latencies)
+        samples.reserve(config.operations);
+
+    const auto runStart = std::chrono::steady_clock::now();
+    for (const auto& [kind, command] : ops)
+    {
+        const auto opStart = std::chrono::steady_clock::now();
+        switch (command.type_)
+        {
+            case OrderCommand::Type::Add:
+                orderbook.AddOrder(command.orderType_, command.orderId_, command.side_, command.price_, command.quantity_);
+                break;
+            case OrderCommand::Type::Cancel:
+                orderbook.CancelOrder(command.orderId_);
+                break;
+            case OrderCommand::Type::Modify:
+                orderbook.ModifyOrder(OrderModify{ command.orderId_, command.side_, command.price_, command.quantity_ });
+                break;
+        }
+        const auto opEnd = std::chrono::steady_clock::now();
+        latencies[static_cast<std::size_t>(kind)].push_back(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(opEnd - opStart).count());
+    }
+    const auto runEnd = std::chrono::steady_clock::now();
+
+    const double seconds = std::chrono::duration<double>(runEnd - runStart).count();
+    std::cout << "ops=" << config.operations
+        << " seconds=" << seconds
+        << " throughput=" << static_cast<std::uint64_t>(config.operations / seconds) << "/s"
+        << " resting=" << orderbook.Size() << "\n";
+    BenchReport("add", latencies[0]);
+    BenchReport("cancel", latencies[1]);
+    BenchReport("modify", latencies[2]);
+    BenchReport("market", latencies[3]);
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc > 1 && std::string{ argv[1] } == "--bench")
+        return RunBenchmark(argc - 2, argv + 2);
+
+    Orderbook orderbook;
+    const OrderId orderId = 1;
+    orderbook.AddOrder(OrderType::GoodTillCancel, orderId, Side::Buy, 100, 10);
     std::cout << orderbook.Size() << std::endl;
     orderbook.CancelOrder(orderId);
     std::cout << orderbook.Size() << std::endl; // 0
     return 0;
-}
\ No newline at end of file
+}